@@ -0,0 +1,973 @@
+/*
+ * Copyright 2016-2018 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures parsing, reflection and GLSL compilation of a corpus of SPIR-V modules.
+// Without arguments, the corpus checked in under bench/corpus is used.
+// The .spvasm files next to the modules are their sources, in spirv-as syntax.
+// With --sweep, synthetic modules of growing size are measured instead, to plot how the compiler scales.
+// Modules with specialization constants are also compiled as a batch of variants, the "variant" phase is the
+// latency of one variant in the batch. Compare it with parse + compile, the cost of compiling a variant cold.
+// Modules with resource bindings are also compiled again after moving every binding, with layout patching
+// enabled. The "rebind" phase is the latency of that compile, compare it with "compile".
+// The "scan" phase is the first pass of a parse alone, see scan_instructions(), and "swap" is the same pass over
+// the module byte swapped, which also swaps it back.
+// With --compile-cache, every module is compiled again by the same compiler through a CompileCache in the given
+// directory. The "cached" phase is the latency of that compile, and the bench fails if it misses the cache.
+// Allocations are counted as well, once per module after the timed iterations. With --alloc-budgets, the bench
+// fails if a module allocates more than its budget, so allocation regressions show up before they ship.
+// The budgets in bench/alloc_budgets.txt were measured with libstdc++, other standard libraries allocate
+// differently, so ctest only checks them when building against libstdc++.
+// --write-alloc-budgets writes new ones from the current counts.
+// --parse-threads sets the threads the timed parses use. Allocations are always counted with a serial parse.
+// --lazy-functions parses lazily, so only the functions the first entry point calls are parsed.
+
+#include "spirv_cross_cache.hpp"
+#include "spirv_glsl.hpp"
+#include "spirv_module_generator.hpp"
+#include "spirv_parser.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using namespace spirv_cross;
+using namespace std;
+
+#ifndef SPIRV_CROSS_BENCH_CORPUS
+#define SPIRV_CROSS_BENCH_CORPUS ""
+#endif
+
+// Every allocation goes through the global operator new, the library's included.
+// Allocations are only counted within an AllocScope, which never spans a threaded parse,
+// so plain counters are enough.
+static bool allocation_counting;
+static uint64_t allocation_count;
+static uint64_t allocation_bytes;
+
+void *operator new(size_t size)
+{
+	if (allocation_counting)
+	{
+		allocation_count++;
+		allocation_bytes += size;
+	}
+	void *ptr = malloc(size ? size : 1);
+	if (!ptr)
+		throw bad_alloc();
+	return ptr;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *ptr) SPIRV_CROSS_NOEXCEPT
+{
+	free(ptr);
+}
+
+void operator delete[](void *ptr) SPIRV_CROSS_NOEXCEPT
+{
+	free(ptr);
+}
+
+void operator delete(void *ptr, size_t) SPIRV_CROSS_NOEXCEPT
+{
+	free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) SPIRV_CROSS_NOEXCEPT
+{
+	free(ptr);
+}
+
+static uint64_t get_current_time_ns()
+{
+	auto now = chrono::steady_clock::now().time_since_epoch();
+	return uint64_t(chrono::duration_cast<chrono::nanoseconds>(now).count());
+}
+
+// Peak resident set size of the process in bytes, 0 if unknown.
+static uint64_t get_peak_rss()
+{
+#ifdef _WIN32
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef __APPLE__
+	return uint64_t(usage.ru_maxrss);
+#else
+	return uint64_t(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+static bool read_spirv_file(const string &path, vector<uint32_t> &spirv)
+{
+	ifstream file(path, ios::binary | ios::ate);
+	if (!file)
+		return false;
+
+	auto size = size_t(file.tellg());
+	if (size == 0 || size % sizeof(uint32_t) != 0)
+		return false;
+
+	spirv.resize(size / sizeof(uint32_t));
+	file.seekg(0);
+	file.read(reinterpret_cast<char *>(spirv.data()), streamsize(size));
+	return bool(file);
+}
+
+static string get_base_name(const string &path)
+{
+	auto pos = path.find_last_of("/\\");
+	return pos == string::npos ? path : path.substr(pos + 1);
+}
+
+struct Samples
+{
+	vector<uint64_t> ns;
+
+	void add(uint64_t sample)
+	{
+		ns.push_back(sample);
+	}
+
+	double mean() const
+	{
+		if (ns.empty())
+			return 0.0;
+
+		double sum = 0.0;
+		for (auto sample : ns)
+			sum += double(sample);
+		return sum / double(ns.size());
+	}
+
+	// Nearest rank percentile.
+	uint64_t percentile(uint32_t p) const
+	{
+		if (ns.empty())
+			return 0;
+
+		auto sorted = ns;
+		sort(begin(sorted), end(sorted));
+		size_t rank = (size_t(p) * sorted.size() + 99) / 100;
+		return sorted[rank ? rank - 1 : 0];
+	}
+};
+
+enum BenchPhase
+{
+	BenchPhaseParse,
+	BenchPhaseReflect,
+	BenchPhaseCompile,
+	BenchPhaseVariant,
+	BenchPhaseRebind,
+	BenchPhaseScan,
+	BenchPhaseSwap,
+	BenchPhaseCached,
+	BenchPhaseCount
+};
+
+static const char *bench_phase_names[BenchPhaseCount] = { "parse", "reflect", "compile", "variant",
+	                                                      "rebind", "scan",    "swap",    "cached" };
+
+enum AllocPhase
+{
+	AllocPhaseParse,
+	AllocPhaseConstruct,
+	AllocPhaseReflect,
+	AllocPhaseCompile,
+	AllocPhaseCount
+};
+
+// "parse" is Parser::parse() alone, "construct" is a parse followed by the CompilerGLSL constructor.
+static const char *alloc_phase_names[AllocPhaseCount] = { "parse", "construct", "reflect", "compile" };
+
+struct AllocStats
+{
+	uint64_t count = 0;
+	uint64_t bytes = 0;
+};
+
+// Counts the allocations made during its lifetime.
+class AllocScope
+{
+public:
+	explicit AllocScope(AllocStats &stats_)
+	    : stats(stats_)
+	    , start_count(allocation_count)
+	    , start_bytes(allocation_bytes)
+	{
+		allocation_counting = true;
+	}
+
+	~AllocScope()
+	{
+		allocation_counting = false;
+		stats.count = allocation_count - start_count;
+		stats.bytes = allocation_bytes - start_bytes;
+	}
+
+private:
+	AllocStats &stats;
+	uint64_t start_count;
+	uint64_t start_bytes;
+};
+
+struct ModuleResult
+{
+	string name;
+	size_t spirv_bytes = 0;
+
+	// Set for synthetic modules of a sweep.
+	const char *sweep_parameter = nullptr;
+	uint32_t sweep_value = 0;
+
+	size_t glsl_bytes = 0;
+	size_t active_buffer_ranges = 0;
+	Samples phases[BenchPhaseCount];
+
+	// Mean of the compiler's own phase timings over all compile() iterations.
+	double compiler_phase_ns[CompilerPhaseCount] = {};
+
+	AllocStats allocations[AllocPhaseCount];
+	string error;
+};
+
+struct BenchOptions
+{
+	uint32_t iterations = 50;
+	uint32_t warmup = 3;
+	uint32_t version = 450;
+	bool es = false;
+	bool vulkan_semantics = false;
+	const char *json_path = nullptr;
+	vector<string> inputs;
+
+	const char *sweep_parameter = nullptr;
+	uint32_t sweep_max = 256;
+
+	// Variants per batch for modules with specialization constants, 0 to skip them.
+	uint32_t spec_variants = 8;
+
+	const char *alloc_budgets_path = nullptr;
+	const char *write_alloc_budgets_path = nullptr;
+
+	// See Parser::set_thread_count() and Parser::set_lazy_function_parsing().
+	uint32_t parse_threads = 1;
+	bool lazy_functions = false;
+
+	const char *compile_cache_dir = nullptr;
+};
+
+// Returns the generator option a sweep varies, or nullptr if the parameter is unknown.
+static uint32_t *get_sweep_option(ModuleGeneratorOptions &options, const char *parameter)
+{
+	if (!strcmp(parameter, "functions"))
+		return &options.functions;
+	else if (!strcmp(parameter, "branches"))
+		return &options.branches;
+	else if (!strcmp(parameter, "parameters"))
+		return &options.parameters;
+	else if (!strcmp(parameter, "loops"))
+		return &options.loops;
+	else if (!strcmp(parameter, "loop_depth"))
+		return &options.loop_depth;
+	else if (!strcmp(parameter, "call_depth"))
+		return &options.call_depth;
+	else if (!strcmp(parameter, "entry_points"))
+		return &options.entry_points;
+	else if (!strcmp(parameter, "locals"))
+		return &options.locals;
+	else if (!strcmp(parameter, "local_arrays"))
+		return &options.local_arrays;
+	else if (!strcmp(parameter, "resources"))
+		return &options.resources;
+	else if (!strcmp(parameter, "constants"))
+		return &options.constants;
+	else if (!strcmp(parameter, "switch_cases"))
+		return &options.switch_cases;
+	else if (!strcmp(parameter, "structs"))
+		return &options.structs;
+	else if (!strcmp(parameter, "id_padding"))
+		return &options.id_padding;
+	else
+		return nullptr;
+}
+
+// Returns the number of active buffer ranges.
+static size_t reflect(const Compiler &compiler)
+{
+	auto resources = compiler.get_shader_resources();
+
+	size_t range_count = 0;
+	for (auto &buffer : resources.uniform_buffers)
+		range_count += compiler.get_active_buffer_ranges(buffer.id).size();
+	for (auto &buffer : resources.storage_buffers)
+		range_count += compiler.get_active_buffer_ranges(buffer.id).size();
+	for (auto &buffer : resources.push_constant_buffers)
+		range_count += compiler.get_active_buffer_ranges(buffer.id).size();
+
+	return range_count;
+}
+
+// Every variant offsets the default value of all specialization constants by its index.
+static vector<vector<SpecializationConstantValue>> build_spec_variants(const Compiler &compiler, uint32_t count)
+{
+	auto spec_constants = compiler.get_specialization_constants();
+	if (spec_constants.empty())
+		return {};
+
+	vector<vector<SpecializationConstantValue>> variants(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		for (auto &spec : spec_constants)
+		{
+			auto &c = compiler.get_constant(spec.id);
+			auto &type = compiler.get_type(c.constant_type);
+
+			uint64_t value;
+			if (type.basetype == SPIRType::Boolean)
+				value = i & 1;
+			else if (type.basetype == SPIRType::Float)
+			{
+				float f = c.scalar_f32() + float(i);
+				uint32_t bits;
+				memcpy(&bits, &f, sizeof(bits));
+				value = bits;
+			}
+			else if (type.basetype == SPIRType::Double)
+			{
+				double d = c.scalar_f64() + double(i);
+				memcpy(&value, &d, sizeof(value));
+			}
+			else if (type.width == 64)
+				value = c.scalar_u64() + i;
+			else
+				value = c.scalar() + i;
+
+			variants[i].push_back({ spec.constant_id, value });
+		}
+	}
+	return variants;
+}
+
+static vector<uint32_t> get_bound_resources(const Compiler &compiler)
+{
+	auto resources = compiler.get_shader_resources();
+	vector<uint32_t> ids;
+	for (auto *list : { &resources.uniform_buffers, &resources.storage_buffers, &resources.storage_images,
+	                    &resources.sampled_images, &resources.separate_images, &resources.separate_samplers })
+	{
+		for (auto &resource : *list)
+			if (compiler.has_decoration(resource.id, spv::DecorationBinding))
+				ids.push_back(resource.id);
+	}
+	return ids;
+}
+
+static void bench_rebind(const BenchOptions &opts, const CompilerGLSL::Options &glsl_opts,
+                         const vector<uint32_t> &spirv, ModuleResult &result)
+{
+	CompilerGLSL compiler(spirv);
+	auto ids = get_bound_resources(compiler);
+	if (ids.empty())
+		return;
+
+	compiler.set_common_options(glsl_opts);
+	compiler.set_layout_patching_enabled(true);
+	compiler.compile();
+
+	for (uint32_t i = 0; i < opts.warmup + opts.iterations; i++)
+	{
+		uint64_t start_ns = get_current_time_ns();
+		for (auto id : ids)
+			compiler.set_decoration(id, spv::DecorationBinding, compiler.get_decoration(id, spv::DecorationBinding) + 1);
+		compiler.compile();
+		uint64_t rebind_ns = get_current_time_ns() - start_ns;
+
+		if (i >= opts.warmup)
+			result.phases[BenchPhaseRebind].add(rebind_ns);
+	}
+}
+
+static void bench_scan(const BenchOptions &opts, const vector<uint32_t> &spirv, ModuleResult &result)
+{
+	auto native = spirv;
+	auto swapped = spirv;
+	for (auto &word : swapped)
+		word = (word >> 24) | ((word >> 8) & 0xff00u) | ((word << 8) & 0xff0000u) | (word << 24);
+
+	for (uint32_t i = 0; i < opts.warmup + opts.iterations; i++)
+	{
+		InstructionScan scan;
+		uint64_t start_ns = get_current_time_ns();
+		scan_instructions(native, scan);
+		uint64_t scan_ns = get_current_time_ns() - start_ns;
+
+		// Scanning swaps the module in place, so every iteration needs a fresh copy.
+		auto module = swapped;
+		InstructionScan swap_scan;
+		start_ns = get_current_time_ns();
+		scan_instructions(module, swap_scan);
+		uint64_t swap_ns = get_current_time_ns() - start_ns;
+
+		if (i >= opts.warmup)
+		{
+			result.phases[BenchPhaseScan].add(scan_ns);
+			result.phases[BenchPhaseSwap].add(swap_ns);
+		}
+	}
+}
+
+static void bench_compile_cache(const BenchOptions &opts, const CompilerGLSL::Options &glsl_opts,
+                                const vector<uint32_t> &spirv, ModuleResult &result)
+{
+	CompileCache cache(opts.compile_cache_dir, 1ull << 30);
+	CompilerGLSL compiler(spirv);
+	compiler.set_common_options(glsl_opts);
+	compiler.set_compile_cache(&cache);
+	compiler.compile();
+
+	for (uint32_t i = 0; i < opts.warmup + opts.iterations; i++)
+	{
+		uint64_t hits = cache.get_hit_count();
+		uint64_t start_ns = get_current_time_ns();
+		compiler.compile();
+		uint64_t cached_ns = get_current_time_ns() - start_ns;
+
+		// Nothing changed since the last compile, so its output must be reused.
+		if (cache.get_hit_count() == hits)
+		{
+			result.error = "compiling again missed the compile cache";
+			return;
+		}
+
+		if (i >= opts.warmup)
+			result.phases[BenchPhaseCached].add(cached_ns);
+	}
+}
+
+static void count_allocations(const BenchOptions &opts, const CompilerGLSL::Options &glsl_opts,
+                              const vector<uint32_t> &spirv, ModuleResult &result)
+{
+	{
+		Parser parser(spirv);
+		parser.set_lazy_function_parsing(opts.lazy_functions);
+		AllocScope scope(result.allocations[AllocPhaseParse]);
+		parser.parse();
+	}
+
+	unique_ptr<CompilerGLSL> compiler;
+	{
+		AllocScope scope(result.allocations[AllocPhaseConstruct]);
+		Parser parser(spirv);
+		parser.set_lazy_function_parsing(opts.lazy_functions);
+		parser.parse();
+		compiler.reset(new CompilerGLSL(move(parser.get_parsed_ir())));
+	}
+
+	{
+		AllocScope scope(result.allocations[AllocPhaseReflect]);
+		compiler->get_shader_resources();
+	}
+
+	compiler->set_common_options(glsl_opts);
+	{
+		AllocScope scope(result.allocations[AllocPhaseCompile]);
+		compiler->compile();
+	}
+}
+
+static void bench_module(const BenchOptions &opts, const vector<uint32_t> &spirv, ModuleResult &result)
+{
+	CompilerGLSL::Options glsl_opts;
+	glsl_opts.version = opts.version;
+	glsl_opts.es = opts.es;
+	glsl_opts.vulkan_semantics = opts.vulkan_semantics;
+
+	uint32_t compile_count = 0;
+	for (uint32_t i = 0; i < opts.warmup + opts.iterations; i++)
+	{
+		bool measure = i >= opts.warmup;
+
+		uint64_t start_ns = get_current_time_ns();
+		Parser parser(spirv);
+		parser.set_thread_count(opts.parse_threads);
+		parser.set_lazy_function_parsing(opts.lazy_functions);
+		parser.parse();
+		CompilerGLSL compiler(move(parser.get_parsed_ir()));
+		uint64_t parse_ns = get_current_time_ns() - start_ns;
+
+		start_ns = get_current_time_ns();
+		size_t range_count = reflect(compiler);
+		uint64_t reflect_ns = get_current_time_ns() - start_ns;
+
+		compiler.set_common_options(glsl_opts);
+		compiler.set_stats_enabled(measure);
+		start_ns = get_current_time_ns();
+		auto glsl = compiler.compile();
+		uint64_t compile_ns = get_current_time_ns() - start_ns;
+
+		if (!measure)
+			continue;
+
+		result.phases[BenchPhaseParse].add(parse_ns);
+		result.phases[BenchPhaseReflect].add(reflect_ns);
+		result.phases[BenchPhaseCompile].add(compile_ns);
+		result.glsl_bytes = glsl.size();
+		result.active_buffer_ranges = range_count;
+
+		auto &stats = compiler.get_stats();
+		for (uint32_t phase = CompilerPhaseParseFixup + 1; phase < CompilerPhaseCount; phase++)
+			result.compiler_phase_ns[phase] += double(stats.phase_ns[phase]);
+		compile_count++;
+	}
+
+	for (auto &phase_ns : result.compiler_phase_ns)
+		phase_ns /= compile_count ? double(compile_count) : 1.0;
+
+	count_allocations(opts, glsl_opts, spirv, result);
+	bench_scan(opts, spirv, result);
+	bench_rebind(opts, glsl_opts, spirv, result);
+	if (opts.compile_cache_dir)
+		bench_compile_cache(opts, glsl_opts, spirv, result);
+
+	if (opts.spec_variants == 0)
+		return;
+
+	for (uint32_t i = 0; i < opts.warmup + opts.iterations; i++)
+	{
+		CompilerGLSL compiler(spirv);
+		compiler.set_common_options(glsl_opts);
+		auto variants = build_spec_variants(compiler, opts.spec_variants);
+		if (variants.empty())
+			return;
+
+		uint64_t start_ns = get_current_time_ns();
+		auto sources = compiler.compile_specialization_variants(variants);
+		uint64_t batch_ns = get_current_time_ns() - start_ns;
+
+		if (i >= opts.warmup)
+			result.phases[BenchPhaseVariant].add(batch_ns / sources.size());
+	}
+}
+
+// Bytes per nanosecond is the same as gigabytes per second, scale to MB/s.
+static double get_throughput_mbps(size_t bytes, double mean_ns)
+{
+	return mean_ns > 0.0 ? double(bytes) / mean_ns * 1000.0 : 0.0;
+}
+
+static void print_text(const BenchOptions &opts, const vector<ModuleResult> &results, uint64_t peak_rss)
+{
+	printf("%u iterations, %u warmup, %u parse threads%s, GLSL %u%s%s\n\n", opts.iterations, opts.warmup,
+	       opts.parse_threads, opts.lazy_functions ? " lazy" : "", opts.version, opts.es ? " es" : "",
+	       opts.vulkan_semantics ? " vulkan" : "");
+	printf("%-24s %-8s %12s %12s %12s %12s\n", "module", "phase", "mean (us)", "p50 (us)", "p99 (us)",
+	       "MB/s");
+
+	for (auto &result : results)
+	{
+		if (!result.error.empty())
+		{
+			printf("%-24s error: %s\n", result.name.c_str(), result.error.c_str());
+			continue;
+		}
+
+		for (uint32_t phase = 0; phase < BenchPhaseCount; phase++)
+		{
+			auto &samples = result.phases[phase];
+			if (samples.ns.empty())
+				continue;
+
+			double mean = samples.mean();
+			printf("%-24s %-8s %12.2f %12.2f %12.2f %12.2f\n", phase == 0 ? result.name.c_str() : "",
+			       bench_phase_names[phase], mean / 1000.0, samples.percentile(50) / 1000.0,
+			       samples.percentile(99) / 1000.0, get_throughput_mbps(result.spirv_bytes, mean));
+		}
+
+		double variant_ns = result.phases[BenchPhaseVariant].mean();
+		if (variant_ns > 0.0)
+		{
+			double cold_ns = result.phases[BenchPhaseParse].mean() + result.phases[BenchPhaseCompile].mean();
+			printf("%-24s %-8s %12.2fx speedup of a variant over parse + compile\n", "", "", cold_ns / variant_ns);
+		}
+
+		double rebind_ns = result.phases[BenchPhaseRebind].mean();
+		if (rebind_ns > 0.0)
+		{
+			double compile_ns = result.phases[BenchPhaseCompile].mean();
+			printf("%-24s %-8s %12.2fx speedup of a rebind over compile\n", "", "", compile_ns / rebind_ns);
+		}
+	}
+
+	printf("\n%-24s %-10s %12s %14s\n", "module", "allocs", "count", "bytes");
+	for (auto &result : results)
+	{
+		if (!result.error.empty())
+			continue;
+
+		for (uint32_t phase = 0; phase < AllocPhaseCount; phase++)
+		{
+			auto &allocs = result.allocations[phase];
+			printf("%-24s %-10s %12llu %14llu\n", phase == 0 ? result.name.c_str() : "", alloc_phase_names[phase],
+			       static_cast<unsigned long long>(allocs.count), static_cast<unsigned long long>(allocs.bytes));
+		}
+	}
+
+	printf("\npeak RSS: %.2f MB\n", double(peak_rss) / (1024.0 * 1024.0));
+}
+
+static void print_json(FILE *file, const BenchOptions &opts, const vector<ModuleResult> &results,
+                       uint64_t peak_rss)
+{
+	fprintf(file, "{\n");
+	fprintf(file, "  \"iterations\": %u,\n", opts.iterations);
+	fprintf(file, "  \"warmup\": %u,\n", opts.warmup);
+	fprintf(file, "  \"parse_threads\": %u,\n", opts.parse_threads);
+	fprintf(file, "  \"lazy_functions\": %s,\n", opts.lazy_functions ? "true" : "false");
+	fprintf(file, "  \"glsl\": { \"version\": %u, \"es\": %s, \"vulkan_semantics\": %s },\n", opts.version,
+	        opts.es ? "true" : "false", opts.vulkan_semantics ? "true" : "false");
+	fprintf(file, "  \"peak_rss_bytes\": %llu,\n", static_cast<unsigned long long>(peak_rss));
+	fprintf(file, "  \"modules\": [");
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		auto &result = results[i];
+		fprintf(file, "%s\n    {\n", i ? "," : "");
+		fprintf(file, "      \"name\": \"%s\",\n", TraceRecorder::escape_json(result.name).c_str());
+		fprintf(file, "      \"spirv_bytes\": %llu,\n", static_cast<unsigned long long>(result.spirv_bytes));
+		if (result.sweep_parameter)
+			fprintf(file, "      \"sweep\": { \"parameter\": \"%s\", \"value\": %u },\n", result.sweep_parameter,
+			        result.sweep_value);
+
+		if (!result.error.empty())
+		{
+			fprintf(file, "      \"error\": \"%s\"\n    }", TraceRecorder::escape_json(result.error).c_str());
+			continue;
+		}
+
+		fprintf(file, "      \"glsl_bytes\": %llu,\n", static_cast<unsigned long long>(result.glsl_bytes));
+		fprintf(file, "      \"active_buffer_ranges\": %llu,\n",
+		        static_cast<unsigned long long>(result.active_buffer_ranges));
+		for (uint32_t phase = 0; phase < BenchPhaseCount; phase++)
+		{
+			auto &samples = result.phases[phase];
+			if (samples.ns.empty())
+				continue;
+
+			double mean = samples.mean();
+			fprintf(file,
+			        "      \"%s\": { \"mean_ns\": %.0f, \"p50_ns\": %llu, \"p99_ns\": %llu, \"throughput_mbps\": %.3f "
+			        "},\n",
+			        bench_phase_names[phase], mean, static_cast<unsigned long long>(samples.percentile(50)),
+			        static_cast<unsigned long long>(samples.percentile(99)),
+			        get_throughput_mbps(result.spirv_bytes, mean));
+		}
+
+		fprintf(file, "      \"allocations\": {");
+		for (uint32_t phase = 0; phase < AllocPhaseCount; phase++)
+			fprintf(file, "%s \"%s\": { \"count\": %llu, \"bytes\": %llu }", phase ? "," : "",
+			        alloc_phase_names[phase], static_cast<unsigned long long>(result.allocations[phase].count),
+			        static_cast<unsigned long long>(result.allocations[phase].bytes));
+		fprintf(file, " },\n");
+
+		fprintf(file, "      \"compiler_phases_mean_ns\": {");
+		for (uint32_t phase = CompilerPhaseParseFixup + 1; phase < CompilerPhaseCount; phase++)
+			fprintf(file, "%s \"%s\": %.0f", phase == CompilerPhaseParseFixup + 1 ? "" : ",",
+			        compiler_phase_name(CompilerPhase(phase)), result.compiler_phase_ns[phase]);
+		fprintf(file, " }\n    }");
+	}
+
+	fprintf(file, "\n  ]\n}\n");
+}
+
+static void print_help()
+{
+	fprintf(stderr, "Usage: spirv_cross_bench\n"
+	                "\t[--iterations <count>]\n"
+	                "\t[--warmup <count>]\n"
+	                "\t[--version <GLSL version>]\n"
+	                "\t[--es]\n"
+	                "\t[--vulkan-semantics]\n"
+	                "\t[--json <path, - for stdout>]\n"
+	                "\t[--sweep <functions|branches|parameters|loops|loop_depth|call_depth|entry_points|\n"
+	                "\t         locals|local_arrays|resources|constants|switch_cases|structs|id_padding>]\n"
+	                "\t[--sweep-max <count>]\n"
+	                "\t[--spec-variants <count>]\n"
+	                "\t[--parse-threads <count, 0 for one per core>]\n"
+	                "\t[--lazy-functions]\n"
+	                "\t[--alloc-budgets <path>]\n"
+	                "\t[--write-alloc-budgets <path>]\n"
+	                "\t[--compile-cache <directory>]\n"
+	                "\t[<module.spv>...]\n");
+}
+
+static bool parse_arguments(int argc, char **argv, BenchOptions &opts)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (!strcmp(arg, "--iterations") && has_value)
+			opts.iterations = uint32_t(strtoul(argv[++i], nullptr, 0));
+		else if (!strcmp(arg, "--warmup") && has_value)
+			opts.warmup = uint32_t(strtoul(argv[++i], nullptr, 0));
+		else if (!strcmp(arg, "--version") && has_value)
+			opts.version = uint32_t(strtoul(argv[++i], nullptr, 0));
+		else if (!strcmp(arg, "--es"))
+			opts.es = true;
+		else if (!strcmp(arg, "--vulkan-semantics"))
+			opts.vulkan_semantics = true;
+		else if (!strcmp(arg, "--json") && has_value)
+			opts.json_path = argv[++i];
+		else if (!strcmp(arg, "--sweep") && has_value)
+			opts.sweep_parameter = argv[++i];
+		else if (!strcmp(arg, "--sweep-max") && has_value)
+			opts.sweep_max = uint32_t(strtoul(argv[++i], nullptr, 0));
+		else if (!strcmp(arg, "--spec-variants") && has_value)
+			opts.spec_variants = uint32_t(strtoul(argv[++i], nullptr, 0));
+		else if (!strcmp(arg, "--parse-threads") && has_value)
+			opts.parse_threads = uint32_t(strtoul(argv[++i], nullptr, 0));
+		else if (!strcmp(arg, "--lazy-functions"))
+			opts.lazy_functions = true;
+		else if (!strcmp(arg, "--alloc-budgets") && has_value)
+			opts.alloc_budgets_path = argv[++i];
+		else if (!strcmp(arg, "--write-alloc-budgets") && has_value)
+			opts.write_alloc_budgets_path = argv[++i];
+		else if (!strcmp(arg, "--compile-cache") && has_value)
+			opts.compile_cache_dir = argv[++i];
+		else if (arg[0] == '-')
+			return false;
+		else
+			opts.inputs.push_back(arg);
+	}
+
+	if (opts.iterations == 0)
+		return false;
+
+	if (opts.sweep_parameter)
+	{
+		ModuleGeneratorOptions options;
+		return get_sweep_option(options, opts.sweep_parameter) && opts.sweep_max != 0;
+	}
+
+	if (opts.inputs.empty())
+	{
+		// The corpus is a ';' separated list of paths, filled in by CMake.
+		string corpus = SPIRV_CROSS_BENCH_CORPUS;
+		size_t start = 0;
+		while (start < corpus.size())
+		{
+			auto end = corpus.find(';', start);
+			if (end == string::npos)
+				end = corpus.size();
+			if (end > start)
+				opts.inputs.push_back(corpus.substr(start, end - start));
+			start = end + 1;
+		}
+	}
+
+	return !opts.inputs.empty();
+}
+
+// A budget file has one "<module> <phase> <max count> <max bytes>" line per budget.
+// Empty lines and lines starting with '#' are ignored. Modules or phases without a budget are not checked.
+// Returns the number of budgets exceeded, or -1 if the file cannot be read.
+static int check_alloc_budgets(const char *path, const vector<ModuleResult> &results)
+{
+	ifstream file(path);
+	if (!file)
+		return -1;
+
+	int exceeded = 0;
+	string line;
+	while (getline(file, line))
+	{
+		auto first = line.find_first_not_of(" \t");
+		if (first == string::npos || line[first] == '#')
+			continue;
+
+		char module[256], phase[64];
+		unsigned long long max_count, max_bytes;
+		if (sscanf(line.c_str(), "%255s %63s %llu %llu", module, phase, &max_count, &max_bytes) != 4)
+		{
+			fprintf(stderr, "Malformed allocation budget: %s\n", line.c_str());
+			return -1;
+		}
+
+		for (auto &result : results)
+		{
+			if (result.name != module || !result.error.empty())
+				continue;
+
+			for (uint32_t i = 0; i < AllocPhaseCount; i++)
+			{
+				if (strcmp(alloc_phase_names[i], phase))
+					continue;
+
+				auto &allocs = result.allocations[i];
+				if (allocs.count > max_count || allocs.bytes > max_bytes)
+				{
+					fprintf(stderr, "%s %s: %llu allocations, %llu bytes, budget is %llu allocations, %llu bytes\n",
+					        module, phase, static_cast<unsigned long long>(allocs.count),
+					        static_cast<unsigned long long>(allocs.bytes), max_count, max_bytes);
+					exceeded++;
+				}
+			}
+		}
+	}
+
+	return exceeded;
+}
+
+// Budgets leave 10% of headroom over the current counts, so small changes do not need a new budget.
+static bool write_alloc_budgets(const char *path, const vector<ModuleResult> &results)
+{
+	FILE *file = fopen(path, "w");
+	if (!file)
+		return false;
+
+	fprintf(file, "# <module> <phase> <max count> <max bytes>\n");
+	for (auto &result : results)
+	{
+		if (!result.error.empty())
+			continue;
+
+		for (uint32_t phase = 0; phase < AllocPhaseCount; phase++)
+		{
+			auto &allocs = result.allocations[phase];
+			fprintf(file, "%s %s %llu %llu\n", result.name.c_str(), alloc_phase_names[phase],
+			        static_cast<unsigned long long>(allocs.count + (allocs.count + 9) / 10),
+			        static_cast<unsigned long long>(allocs.bytes + (allocs.bytes + 9) / 10));
+		}
+	}
+
+	fclose(file);
+	return true;
+}
+
+static void run_module(const BenchOptions &opts, const vector<uint32_t> &spirv, ModuleResult &result)
+{
+	result.spirv_bytes = spirv.size() * sizeof(uint32_t);
+	try
+	{
+		bench_module(opts, spirv, result);
+	}
+	catch (const std::exception &e)
+	{
+		result.error = e.what();
+	}
+}
+
+int main(int argc, char **argv)
+{
+	BenchOptions opts;
+	if (!parse_arguments(argc, argv, opts))
+	{
+		print_help();
+		return EXIT_FAILURE;
+	}
+
+	vector<ModuleResult> results;
+	for (auto &input : opts.inputs)
+	{
+		ModuleResult result;
+		result.name = get_base_name(input);
+
+		vector<uint32_t> spirv;
+		if (read_spirv_file(input, spirv))
+			run_module(opts, spirv, result);
+		else
+			result.error = "failed to read " + input;
+
+		results.push_back(move(result));
+	}
+
+	// Every other parameter keeps its default while one of them doubles.
+	if (opts.sweep_parameter)
+	{
+		for (uint32_t value = 1; value != 0 && value <= opts.sweep_max; value *= 2)
+		{
+			ModuleGeneratorOptions options;
+			*get_sweep_option(options, opts.sweep_parameter) = value;
+
+			ModuleResult result;
+			result.name = string(opts.sweep_parameter) + "=" + to_string(value);
+			result.sweep_parameter = opts.sweep_parameter;
+			result.sweep_value = value;
+			run_module(opts, generate_module(options), result);
+			results.push_back(move(result));
+		}
+	}
+
+	uint64_t peak_rss = get_peak_rss();
+
+	if (!opts.json_path)
+		print_text(opts, results, peak_rss);
+	else if (!strcmp(opts.json_path, "-"))
+		print_json(stdout, opts, results, peak_rss);
+	else
+	{
+		FILE *file = fopen(opts.json_path, "w");
+		if (!file)
+		{
+			fprintf(stderr, "Failed to open %s for writing.\n", opts.json_path);
+			return EXIT_FAILURE;
+		}
+		print_json(file, opts, results, peak_rss);
+		fclose(file);
+		print_text(opts, results, peak_rss);
+	}
+
+	if (opts.write_alloc_budgets_path && !write_alloc_budgets(opts.write_alloc_budgets_path, results))
+	{
+		fprintf(stderr, "Failed to open %s for writing.\n", opts.write_alloc_budgets_path);
+		return EXIT_FAILURE;
+	}
+
+	if (opts.alloc_budgets_path)
+	{
+		int exceeded = check_alloc_budgets(opts.alloc_budgets_path, results);
+		if (exceeded < 0)
+		{
+			fprintf(stderr, "Failed to read allocation budgets from %s.\n", opts.alloc_budgets_path);
+			return EXIT_FAILURE;
+		}
+		else if (exceeded > 0)
+			return EXIT_FAILURE;
+	}
+
+	for (auto &result : results)
+		if (!result.error.empty())
+			return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2016-2018 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Writes a synthetic SPIR-V module, see ModuleGeneratorOptions for its shape.
+
+#include "spirv_module_generator.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace spirv_cross;
+using namespace std;
+
+static void print_help()
+{
+	fprintf(stderr, "Usage: spirv_cross_gen\n"
+	                "\t[--functions <count>]\n"
+	                "\t[--branches <count per function>]\n"
+	                "\t[--parameters <count per function>]\n"
+	                "\t[--loops <count per function>]\n"
+	                "\t[--loop-depth <count>]\n"
+	                "\t[--call-depth <count>]\n"
+	                "\t[--entry-points <count>]\n"
+	                "\t[--locals <count per function>]\n"
+	                "\t[--local-arrays <count per function>]\n"
+	                "\t[--resources <count>]\n"
+	                "\t[--constants <count>]\n"
+	                "\t[--switch-cases <count per function>]\n"
+	                "\t[--structs <count>]\n"
+	                "\t[--id-padding <count>]\n"
+	                "\t[--strip]\n"
+	                "\t--output <module.spv>\n");
+}
+
+int main(int argc, char **argv)
+{
+	ModuleGeneratorOptions options;
+	const char *output = nullptr;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		bool has_value = i + 1 < argc;
+		uint32_t *count = nullptr;
+
+		if (!strcmp(arg, "--functions"))
+			count = &options.functions;
+		else if (!strcmp(arg, "--branches"))
+			count = &options.branches;
+		else if (!strcmp(arg, "--parameters"))
+			count = &options.parameters;
+		else if (!strcmp(arg, "--loops"))
+			count = &options.loops;
+		else if (!strcmp(arg, "--loop-depth"))
+			count = &options.loop_depth;
+		else if (!strcmp(arg, "--call-depth"))
+			count = &options.call_depth;
+		else if (!strcmp(arg, "--entry-points"))
+			count = &options.entry_points;
+		else if (!strcmp(arg, "--locals"))
+			count = &options.locals;
+		else if (!strcmp(arg, "--local-arrays"))
+			count = &options.local_arrays;
+		else if (!strcmp(arg, "--resources"))
+			count = &options.resources;
+		else if (!strcmp(arg, "--constants"))
+			count = &options.constants;
+		else if (!strcmp(arg, "--switch-cases"))
+			count = &options.switch_cases;
+		else if (!strcmp(arg, "--structs"))
+			count = &options.structs;
+		else if (!strcmp(arg, "--id-padding"))
+			count = &options.id_padding;
+		else if (!strcmp(arg, "--strip"))
+			options.names = false;
+		else if (!strcmp(arg, "--output") && has_value)
+			output = argv[++i];
+		else
+		{
+			print_help();
+			return EXIT_FAILURE;
+		}
+
+		if (count)
+		{
+			if (!has_value)
+			{
+				print_help();
+				return EXIT_FAILURE;
+			}
+			*count = uint32_t(strtoul(argv[++i], nullptr, 0));
+		}
+	}
+
+	if (!output)
+	{
+		print_help();
+		return EXIT_FAILURE;
+	}
+
+	auto module = generate_module(options);
+
+	FILE *file = fopen(output, "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Failed to open %s for writing.\n", output);
+		return EXIT_FAILURE;
+	}
+
+	bool written = fwrite(module.data(), sizeof(uint32_t), module.size(), file) == module.size();
+	if (fclose(file) != 0 || !written)
+	{
+		fprintf(stderr, "Failed to write %s.\n", output);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
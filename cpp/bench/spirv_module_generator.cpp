@@ -0,0 +1,574 @@
+/*
+ * Copyright 2016-2018 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "spirv_module_generator.hpp"
+#include "spirv.hpp"
+#include <algorithm>
+#include <initializer_list>
+#include <string.h>
+#include <string>
+
+using namespace spv;
+using namespace std;
+
+namespace spirv_cross
+{
+namespace
+{
+struct Section
+{
+	vector<uint32_t> words;
+
+	void op(Op opcode, initializer_list<uint32_t> operands)
+	{
+		words.push_back(uint32_t(operands.size() + 1) << 16 | uint32_t(opcode));
+		words.insert(end(words), begin(operands), end(operands));
+	}
+
+	void op(Op opcode, const vector<uint32_t> &operands)
+	{
+		words.push_back(uint32_t(operands.size() + 1) << 16 | uint32_t(opcode));
+		words.insert(end(words), begin(operands), end(operands));
+	}
+
+	// Instruction with a literal string operand, which may be followed by more operands.
+	void op(Op opcode, initializer_list<uint32_t> operands, const string &str,
+	        initializer_list<uint32_t> trailing = {})
+	{
+		vector<uint32_t> all(operands);
+		size_t offset = all.size();
+		all.resize(offset + str.size() / 4 + 1);
+		memcpy(&all[offset], str.data(), str.size());
+		all.insert(end(all), begin(trailing), end(trailing));
+		op(opcode, all);
+	}
+};
+
+uint32_t float_bits(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+class ModuleGenerator
+{
+public:
+	explicit ModuleGenerator(const ModuleGeneratorOptions &options_)
+	    : options(options_)
+	{
+		options.locals = max(options.locals, 1u);
+		options.call_depth = max(options.call_depth, 1u);
+		options.entry_points = max(options.entry_points, 1u);
+		options.loop_depth = max(options.loop_depth, 1u);
+	}
+
+	vector<uint32_t> generate();
+
+private:
+	ModuleGeneratorOptions options;
+	uint32_t next_id = 1;
+
+	Section names, decorations, globals, code;
+
+	uint32_t type_void = 0, type_float = 0, type_int = 0, type_uint = 0, type_bool = 0, type_vec4 = 0;
+	uint32_t type_main = 0, type_helper = 0;
+	uint32_t type_ptr_function_float = 0, type_ptr_uniform_vec4 = 0, type_ptr_private_float = 0, type_array = 0;
+	uint32_t type_ptr_function_local_array = 0, type_ptr_function_int = 0;
+	uint32_t const_int_1 = 0, const_int_4 = 0;
+	uint32_t const_int_0 = 0, const_half = 0, const_two = 0, lut = 0, local_array_initializer = 0;
+	uint32_t output = 0;
+	vector<uint32_t> ubos, helpers, case_constants, entry_functions;
+
+	// Pointer parameters of the function being emitted, or the variables main() passes for them.
+	vector<uint32_t> parameters;
+
+	uint32_t id()
+	{
+		return next_id++;
+	}
+
+	void name(uint32_t target, const string &str)
+	{
+		if (options.names)
+			names.op(OpName, { target }, str);
+	}
+
+	void emit_types_and_globals();
+	void emit_helper(uint32_t index);
+	void emit_main(uint32_t entry);
+
+	// These thread value through the locals and return the resulting value.
+	uint32_t emit_loops(const vector<uint32_t> &locals, const vector<uint32_t> &counters, uint32_t depth,
+	                    uint32_t value);
+	uint32_t emit_branches(const vector<uint32_t> &locals, uint32_t value);
+	uint32_t emit_switch(const vector<uint32_t> &locals, uint32_t value);
+};
+
+void ModuleGenerator::emit_types_and_globals()
+{
+	type_void = id();
+	globals.op(OpTypeVoid, { type_void });
+	type_main = id();
+	globals.op(OpTypeFunction, { type_main, type_void });
+	type_float = id();
+	globals.op(OpTypeFloat, { type_float, 32 });
+	type_int = id();
+	globals.op(OpTypeInt, { type_int, 32, 1 });
+	type_uint = id();
+	globals.op(OpTypeInt, { type_uint, 32, 0 });
+	type_bool = id();
+	globals.op(OpTypeBool, { type_bool });
+	type_vec4 = id();
+	globals.op(OpTypeVector, { type_vec4, type_float, 4 });
+	type_helper = id();
+	type_ptr_function_float = id();
+	globals.op(OpTypePointer, { type_ptr_function_float, StorageClassFunction, type_float });
+
+	vector<uint32_t> helper_operands = { type_helper, type_float, type_float };
+	helper_operands.insert(end(helper_operands), options.parameters, type_ptr_function_float);
+	globals.op(OpTypeFunction, helper_operands);
+	type_ptr_uniform_vec4 = id();
+	globals.op(OpTypePointer, { type_ptr_uniform_vec4, StorageClassUniform, type_vec4 });
+
+	const_int_0 = id();
+	globals.op(OpConstant, { type_int, const_int_0, 0 });
+
+	if (options.loops)
+	{
+		type_ptr_function_int = id();
+		globals.op(OpTypePointer, { type_ptr_function_int, StorageClassFunction, type_int });
+		const_int_1 = id();
+		globals.op(OpConstant, { type_int, const_int_1, 1 });
+		const_int_4 = id();
+		globals.op(OpConstant, { type_int, const_int_4, 4 });
+	}
+	const_half = id();
+	globals.op(OpConstant, { type_float, const_half, float_bits(0.5f) });
+	const_two = id();
+	globals.op(OpConstant, { type_float, const_two, float_bits(2.0f) });
+
+	if (options.local_arrays)
+	{
+		uint32_t length = id();
+		globals.op(OpConstant, { type_uint, length, 4 });
+		uint32_t type_local_array = id();
+		globals.op(OpTypeArray, { type_local_array, type_float, length });
+		type_ptr_function_local_array = id();
+		globals.op(OpTypePointer, { type_ptr_function_local_array, StorageClassFunction, type_local_array });
+		local_array_initializer = id();
+		globals.op(OpConstantComposite,
+		           { type_local_array, local_array_initializer, const_half, const_two, const_half, const_two });
+	}
+
+	if (options.constants)
+	{
+		uint32_t length = id();
+		globals.op(OpConstant, { type_uint, length, options.constants });
+		type_array = id();
+		globals.op(OpTypeArray, { type_array, type_float, length });
+
+		vector<uint32_t> elements = { type_array, 0 };
+		for (uint32_t i = 0; i < options.constants; i++)
+		{
+			uint32_t element = id();
+			globals.op(OpConstant, { type_float, element, float_bits(float(i) * 0.25f) });
+			elements.push_back(element);
+		}
+
+		uint32_t initializer = id();
+		elements[1] = initializer;
+		globals.op(OpConstantComposite, elements);
+
+		// A private variable keeps the array in one place, instead of inlining it into every expression.
+		uint32_t type_ptr_private_array = id();
+		globals.op(OpTypePointer, { type_ptr_private_array, StorageClassPrivate, type_array });
+		type_ptr_private_float = id();
+		globals.op(OpTypePointer, { type_ptr_private_float, StorageClassPrivate, type_float });
+		lut = id();
+		globals.op(OpVariable, { type_ptr_private_array, lut, StorageClassPrivate, initializer });
+		name(lut, "lut");
+	}
+
+	for (uint32_t i = 0; i < options.switch_cases; i++)
+	{
+		case_constants.push_back(id());
+		globals.op(OpConstant, { type_float, case_constants.back(), float_bits(float(i + 1)) });
+	}
+
+	uint32_t type_ptr_output_vec4 = id();
+	globals.op(OpTypePointer, { type_ptr_output_vec4, StorageClassOutput, type_vec4 });
+	output = id();
+	globals.op(OpVariable, { type_ptr_output_vec4, output, StorageClassOutput });
+	name(output, "FragColor");
+	decorations.op(OpDecorate, { output, DecorationLocation, 0 });
+
+	for (uint32_t i = 0; i < options.resources; i++)
+	{
+		// Every buffer gets a distinct block type, as they would in a real shader.
+		uint32_t block = id();
+		globals.op(OpTypeStruct, { block, type_vec4 });
+		uint32_t ptr = id();
+		globals.op(OpTypePointer, { ptr, StorageClassUniform, block });
+		uint32_t var = id();
+		globals.op(OpVariable, { ptr, var, StorageClassUniform });
+
+		name(block, "Block" + to_string(i));
+		if (options.names)
+			names.op(OpMemberName, { block, 0 }, "value");
+		name(var, "block" + to_string(i));
+
+		decorations.op(OpDecorate, { block, DecorationBlock });
+		decorations.op(OpMemberDecorate, { block, 0, DecorationOffset, 0 });
+		decorations.op(OpDecorate, { var, DecorationDescriptorSet, 0 });
+		decorations.op(OpDecorate, { var, DecorationBinding, i });
+		ubos.push_back(var);
+	}
+
+	uint32_t nested = 0;
+	for (uint32_t i = 0; i < options.structs; i++)
+	{
+		uint32_t type = id();
+		uint32_t layout = (i % 2) * 16;
+		if (nested)
+		{
+			globals.op(OpTypeStruct, { type, type_vec4, type_float, nested });
+			decorations.op(OpMemberDecorate, { type, 2, DecorationOffset, 32 + layout });
+		}
+		else
+			globals.op(OpTypeStruct, { type, type_vec4, type_float });
+
+		name(type, "Struct" + to_string(i / 2));
+		decorations.op(OpMemberDecorate, { type, 0, DecorationOffset, 0 });
+		decorations.op(OpMemberDecorate, { type, 1, DecorationOffset, 16 + layout });
+
+		// The next pair nests the first struct of this one.
+		if (i % 2 == 1)
+			nested = type - 1;
+	}
+}
+
+uint32_t ModuleGenerator::emit_loops(const vector<uint32_t> &locals, const vector<uint32_t> &counters,
+                                     uint32_t depth, uint32_t value)
+{
+	if (depth == counters.size())
+	{
+		value = emit_branches(locals, value);
+
+		uint32_t condition = id(), return_label = id(), merge_label = id();
+		code.op(OpFOrdGreaterThan, { type_bool, condition, value, const_two });
+		code.op(OpSelectionMerge, { merge_label, SelectionControlMaskNone });
+		code.op(OpBranchConditional, { condition, return_label, merge_label });
+
+		code.op(OpLabel, { return_label });
+		code.op(OpReturnValue, { value });
+
+		code.op(OpLabel, { merge_label });
+		return value;
+	}
+
+	// Values defined in the loop body do not dominate the merge block, so value goes through a local.
+	uint32_t local = locals.front();
+	uint32_t counter = counters[depth];
+	code.op(OpStore, { local, value });
+	code.op(OpStore, { counter, const_int_0 });
+
+	uint32_t header_label = id(), condition_label = id(), body_label = id(), continue_label = id(),
+	         merge_label = id();
+	code.op(OpBranch, { header_label });
+
+	code.op(OpLabel, { header_label });
+	code.op(OpLoopMerge, { merge_label, continue_label, LoopControlMaskNone });
+	code.op(OpBranch, { condition_label });
+
+	code.op(OpLabel, { condition_label });
+	uint32_t index = id(), condition = id();
+	code.op(OpLoad, { type_int, index, counter });
+	code.op(OpSLessThan, { type_bool, condition, index, const_int_4 });
+	code.op(OpBranchConditional, { condition, body_label, merge_label });
+
+	code.op(OpLabel, { body_label });
+	uint32_t loaded = id();
+	code.op(OpLoad, { type_float, loaded, local });
+	code.op(OpStore, { local, emit_loops(locals, counters, depth + 1, loaded) });
+	code.op(OpBranch, { continue_label });
+
+	code.op(OpLabel, { continue_label });
+	uint32_t current = id(), next = id();
+	code.op(OpLoad, { type_int, current, counter });
+	code.op(OpIAdd, { type_int, next, current, const_int_1 });
+	code.op(OpStore, { counter, next });
+	code.op(OpBranch, { header_label });
+
+	code.op(OpLabel, { merge_label });
+	uint32_t result = id();
+	code.op(OpLoad, { type_float, result, local });
+	return result;
+}
+
+uint32_t ModuleGenerator::emit_branches(const vector<uint32_t> &locals, uint32_t value)
+{
+	for (uint32_t i = 0; i < options.branches; i++)
+	{
+		uint32_t local = locals[i % locals.size()];
+		uint32_t condition = id();
+		code.op(OpFOrdLessThan, { type_bool, condition, value, const_two });
+
+		uint32_t then_label = id(), else_label = id(), merge_label = id();
+		code.op(OpSelectionMerge, { merge_label, SelectionControlMaskNone });
+		code.op(OpBranchConditional, { condition, then_label, else_label });
+
+		code.op(OpLabel, { then_label });
+		uint32_t then_value = id();
+		code.op(OpFAdd, { type_float, then_value, value, const_half });
+		code.op(OpStore, { local, then_value });
+		for (uint32_t j = 2 * i; j < parameters.size(); j += 2 * options.branches)
+			code.op(OpStore, { parameters[j], then_value });
+		code.op(OpBranch, { merge_label });
+
+		code.op(OpLabel, { else_label });
+		uint32_t else_value = id();
+		code.op(OpFMul, { type_float, else_value, value, const_half });
+		code.op(OpStore, { local, else_value });
+		code.op(OpBranch, { merge_label });
+
+		code.op(OpLabel, { merge_label });
+		value = id();
+		code.op(OpLoad, { type_float, value, local });
+	}
+
+	return value;
+}
+
+uint32_t ModuleGenerator::emit_switch(const vector<uint32_t> &locals, uint32_t value)
+{
+	uint32_t local = locals.front();
+	code.op(OpStore, { local, value });
+
+	uint32_t selector = id();
+	code.op(OpConvertFToS, { type_int, selector, value });
+
+	uint32_t default_label = id(), merge_label = id();
+	vector<uint32_t> switch_operands = { selector, default_label };
+	vector<uint32_t> case_labels;
+	for (uint32_t i = 0; i < options.switch_cases; i++)
+	{
+		case_labels.push_back(id());
+		switch_operands.push_back(i);
+		switch_operands.push_back(case_labels.back());
+	}
+
+	code.op(OpSelectionMerge, { merge_label, SelectionControlMaskNone });
+	code.op(OpSwitch, switch_operands);
+
+	for (uint32_t i = 0; i < options.switch_cases; i++)
+	{
+		code.op(OpLabel, { case_labels[i] });
+		uint32_t case_value = id();
+		code.op(OpFAdd, { type_float, case_value, value, case_constants[i] });
+		code.op(OpStore, { local, case_value });
+		code.op(OpBranch, { merge_label });
+	}
+
+	code.op(OpLabel, { default_label });
+	code.op(OpBranch, { merge_label });
+
+	code.op(OpLabel, { merge_label });
+	uint32_t result = id();
+	code.op(OpLoad, { type_float, result, local });
+	return result;
+}
+
+void ModuleGenerator::emit_helper(uint32_t index)
+{
+	uint32_t function = helpers[index];
+	name(function, "helper" + to_string(index));
+
+	code.op(OpFunction, { type_float, function, FunctionControlMaskNone, type_helper });
+	uint32_t value = id();
+	code.op(OpFunctionParameter, { type_float, value });
+	name(value, "x");
+
+	parameters.clear();
+	for (uint32_t i = 0; i < options.parameters; i++)
+	{
+		parameters.push_back(id());
+		code.op(OpFunctionParameter, { type_ptr_function_float, parameters.back() });
+		name(parameters.back(), "p" + to_string(i));
+	}
+
+	code.op(OpLabel, { id() });
+
+	vector<uint32_t> locals;
+	for (uint32_t i = 0; i < options.locals; i++)
+	{
+		uint32_t local = id();
+		code.op(OpVariable, { type_ptr_function_float, local, StorageClassFunction });
+		name(local, "l" + to_string(i));
+		locals.push_back(local);
+	}
+
+	vector<uint32_t> counters;
+	for (uint32_t i = 0; options.loops && i < options.loop_depth; i++)
+	{
+		uint32_t counter = id();
+		code.op(OpVariable, { type_ptr_function_int, counter, StorageClassFunction });
+		name(counter, "i" + to_string(i));
+		counters.push_back(counter);
+	}
+
+	vector<uint32_t> local_arrays;
+	for (uint32_t i = 0; i < options.local_arrays; i++)
+	{
+		uint32_t local_array = id();
+		code.op(OpVariable, { type_ptr_function_local_array, local_array, StorageClassFunction });
+		name(local_array, "a" + to_string(i));
+		local_arrays.push_back(local_array);
+	}
+
+	for (auto local : locals)
+		code.op(OpStore, { local, value });
+
+	for (auto local_array : local_arrays)
+		code.op(OpStore, { local_array, local_array_initializer });
+
+	for (uint32_t i = 0; i < options.local_arrays; i++)
+	{
+		uint32_t ptr = id(), element = id(), sum = id();
+		code.op(OpAccessChain, { type_ptr_function_float, ptr, local_arrays[i], const_int_0 });
+		code.op(OpLoad, { type_float, element, ptr });
+		code.op(OpFAdd, { type_float, sum, value, element });
+		value = sum;
+	}
+
+	if (!ubos.empty())
+	{
+		uint32_t ptr = id(), loaded = id(), component = id(), sum = id();
+		code.op(OpAccessChain, { type_ptr_uniform_vec4, ptr, ubos[index % ubos.size()], const_int_0 });
+		code.op(OpLoad, { type_vec4, loaded, ptr });
+		code.op(OpCompositeExtract, { type_float, component, loaded, index % 4 });
+		code.op(OpFAdd, { type_float, sum, value, component });
+		value = sum;
+	}
+
+	if (lut)
+	{
+		uint32_t element_index = id();
+		globals.op(OpConstant, { type_int, element_index, index % options.constants });
+
+		uint32_t ptr = id(), element = id(), sum = id();
+		code.op(OpAccessChain, { type_ptr_private_float, ptr, lut, element_index });
+		code.op(OpLoad, { type_float, element, ptr });
+		code.op(OpFAdd, { type_float, sum, value, element });
+		value = sum;
+	}
+
+	if (options.loops)
+	{
+		for (uint32_t i = 0; i < options.loops; i++)
+			value = emit_loops(locals, counters, 0, value);
+	}
+	else
+		value = emit_branches(locals, value);
+
+	if (options.switch_cases)
+		value = emit_switch(locals, value);
+
+	uint32_t callee = index + 1;
+	if (callee < options.functions && callee % options.call_depth != 0)
+	{
+		uint32_t result = id();
+		vector<uint32_t> operands = { type_float, result, helpers[callee], value };
+		operands.insert(end(operands), begin(parameters), end(parameters));
+		code.op(OpFunctionCall, operands);
+		value = result;
+	}
+
+	for (uint32_t i = 1; i < parameters.size(); i += 2)
+		code.op(OpStore, { parameters[i], value });
+
+	code.op(OpReturnValue, { value });
+	code.op(OpFunctionEnd, {});
+}
+
+void ModuleGenerator::emit_main(uint32_t entry)
+{
+	code.op(OpFunction, { type_void, entry_functions[entry], FunctionControlMaskNone, type_main });
+	code.op(OpLabel, { id() });
+
+	parameters.clear();
+	for (uint32_t i = 0; i < options.parameters; i++)
+	{
+		parameters.push_back(id());
+		code.op(OpVariable, { type_ptr_function_float, parameters.back(), StorageClassFunction });
+		name(parameters.back(), "v" + to_string(i));
+	}
+
+	uint32_t value = const_half;
+	uint32_t stride = options.call_depth * options.entry_points;
+	for (uint32_t i = entry * options.call_depth; i < options.functions; i += stride)
+	{
+		uint32_t result = id();
+		vector<uint32_t> operands = { type_float, result, helpers[i], value };
+		operands.insert(end(operands), begin(parameters), end(parameters));
+		code.op(OpFunctionCall, operands);
+		value = result;
+	}
+
+	uint32_t color = id();
+	code.op(OpCompositeConstruct, { type_vec4, color, value, value, value, value });
+	code.op(OpStore, { output, color });
+	code.op(OpReturn, {});
+	code.op(OpFunctionEnd, {});
+}
+
+vector<uint32_t> ModuleGenerator::generate()
+{
+	for (uint32_t i = 0; i < options.entry_points; i++)
+		entry_functions.push_back(id());
+	for (uint32_t i = 0; i < options.functions; i++)
+		helpers.push_back(id());
+
+	emit_types_and_globals();
+	for (uint32_t i = 0; i < options.entry_points; i++)
+		emit_main(i);
+	for (uint32_t i = 0; i < options.functions; i++)
+		emit_helper(i);
+
+	Section preamble;
+	preamble.op(OpCapability, { CapabilityShader });
+	preamble.op(OpMemoryModel, { AddressingModelLogical, MemoryModelGLSL450 });
+	for (uint32_t i = 0; i < options.entry_points; i++)
+	{
+		string entry_name = i ? "main" + to_string(i) : "main";
+		preamble.op(OpEntryPoint, { ExecutionModelFragment, entry_functions[i] }, entry_name, { output });
+		name(entry_functions[i], entry_name);
+	}
+	for (auto entry : entry_functions)
+		preamble.op(OpExecutionMode, { entry, ExecutionModeOriginUpperLeft });
+
+	vector<uint32_t> module = { MagicNumber, 0x10000, 0, next_id + options.id_padding, 0 };
+	for (auto *section : { &preamble, &names, &decorations, &globals, &code })
+		module.insert(end(module), begin(section->words), end(section->words));
+	return module;
+}
+} // namespace
+
+vector<uint32_t> generate_module(const ModuleGeneratorOptions &options)
+{
+	return ModuleGenerator(options).generate();
+}
+} // namespace spirv_cross
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2016-2018 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SPIRV_MODULE_GENERATOR_HPP
+#define SPIRV_MODULE_GENERATOR_HPP
+
+#include <stdint.h>
+#include <vector>
+
+namespace spirv_cross
+{
+// Shape of a synthetic fragment shader module.
+// Every helper function is "float f(float)" and threads its argument through all the constructs below,
+// so nothing is dead code and the whole module ends up in the output.
+struct ModuleGeneratorOptions
+{
+	// Helper functions, besides main().
+	uint32_t functions = 16;
+
+	// if/else constructs per function, each of them adds three blocks.
+	uint32_t branches = 4;
+
+	// Loop nests per function, one after the other. Each of them contains the if/else constructs,
+	// and its innermost loop may return early, the way a search loop does. 0 for no loops.
+	uint32_t loops = 0;
+
+	// Loops per nest.
+	uint32_t loop_depth = 1;
+
+	// Pointer parameters per helper function. Even ones are written in one branch of the if/else constructs only,
+	// so they have to be inout, odd ones are written at the end of the function, so they are out.
+	uint32_t parameters = 0;
+
+	// Helper functions form call chains of this length, main() calls the head of every chain.
+	uint32_t call_depth = 4;
+
+	// Entry points, named main, main1, main2 and so on. They take turns calling the heads of the call chains,
+	// so they share none of the helper functions, the way the entry points of a library module don't.
+	uint32_t entry_points = 1;
+
+	// Function storage variables per function. At least one is always declared.
+	uint32_t locals = 4;
+
+	// Function storage arrays per function. Each of them is initialized with a constant array and read once,
+	// so they all end up as lookup tables.
+	uint32_t local_arrays = 0;
+
+	// Uniform buffers, each helper function reads one of them.
+	uint32_t resources = 4;
+
+	// Length of a float array with a constant initializer, each helper function reads one element.
+	uint32_t constants = 64;
+
+	// Cases of a switch statement per function, 0 for no switch.
+	uint32_t switch_cases = 0;
+
+	// Named struct types besides the buffer blocks. They come in pairs which differ only in their member offsets,
+	// the way a struct used in blocks of different layouts is declared, and every pair nests the previous one.
+	uint32_t structs = 0;
+
+	// Unused IDs added to the ID bound.
+	uint32_t id_padding = 0;
+
+	// Emit OpName for functions, resources and locals.
+	bool names = true;
+};
+
+std::vector<uint32_t> generate_module(const ModuleGeneratorOptions &options);
+} // namespace spirv_cross
+
+#endif
@@ -48,6 +48,17 @@ uint32_t CFG::find_common_dominator(uint32_t a, uint32_t b) const
 	return a;
 }
 
+uint64_t CFG::get_heap_size() const
+{
+	uint64_t size = heap_size(preceding_edges) + heap_size(succeeding_edges) + heap_size(immediate_dominators) +
+	                heap_size(visit_order) + heap_size(post_order);
+	for (auto &edges : preceding_edges)
+		size += heap_size(edges);
+	for (auto &edges : succeeding_edges)
+		size += heap_size(edges);
+	return size;
+}
+
 void CFG::build_immediate_dominators()
 {
 	// Traverse the post-order in reverse and build up the immediate dominator tree.
@@ -109,7 +120,7 @@ bool CFG::post_order_visit(uint32_t block_id)
 		break;
 
 	case SPIRBlock::MultiSelect:
-		for (auto &target : block.cases)
+		for (auto &target : compiler.ir.get_cases(block))
 		{
 			if (post_order_visit(target.block))
 				add_branch(block_id, target.block);
@@ -210,7 +221,7 @@ void DominatorBuilder::lift_continue_block_dominator()
 		break;
 
 	case SPIRBlock::MultiSelect:
-		for (auto &target : block.cases)
+		for (auto &target : cfg.get_compiler().ir.get_cases(block))
 		{
 			if (cfg.get_visit_order(target.block) > post_order)
 				back_edge_dominator = true;
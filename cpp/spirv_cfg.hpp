@@ -55,8 +55,22 @@ public:
 		return uint32_t(v);
 	}
 
+	// Back edges are not part of the graph, so the successors of a block come before it.
+	const std::vector<uint32_t> &get_post_order() const
+	{
+		return post_order;
+	}
+
+	bool is_reachable(uint32_t block) const
+	{
+		return visit_order[block] > 0;
+	}
+
 	uint32_t find_common_dominator(uint32_t a, uint32_t b) const;
 
+	// Approximate heap memory held by the graph, see CompilerMemoryFootprint.
+	uint64_t get_heap_size() const;
+
 	const std::vector<uint32_t> &get_preceding_edges(uint32_t block) const
 	{
 		return preceding_edges[block];
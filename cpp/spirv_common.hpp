@@ -291,12 +291,94 @@ inline std::string convert_to_string(double t)
 #pragma warning(pop)
 #endif
 
+// Approximate heap memory owned by standard containers, for memory footprints.
+// Only the storage of the container is counted, whatever its elements own is up to the caller.
+template <typename T>
+inline uint64_t heap_size(const std::vector<T> &v)
+{
+	return uint64_t(v.capacity()) * sizeof(T);
+}
+
+inline uint64_t heap_size(const std::vector<bool> &v)
+{
+	return (uint64_t(v.capacity()) + 7) / 8;
+}
+
+inline uint64_t heap_size(const std::string &s)
+{
+	// Short strings live inside the string object.
+	auto data = reinterpret_cast<uintptr_t>(s.data());
+	auto self = reinterpret_cast<uintptr_t>(&s);
+	if (data >= self && data < self + sizeof(s))
+		return 0;
+	return uint64_t(s.capacity()) + 1;
+}
+
+// Nodes are assumed to hold the value, the next pointer and the cached hash.
+template <typename T, typename... Ts>
+inline uint64_t heap_size(const std::unordered_set<T, Ts...> &s)
+{
+	return uint64_t(s.bucket_count()) * sizeof(void *) + uint64_t(s.size()) * (sizeof(T) + 2 * sizeof(void *));
+}
+
+template <typename K, typename V, typename... Ts>
+inline uint64_t heap_size(const std::unordered_map<K, V, Ts...> &m)
+{
+	return uint64_t(m.bucket_count()) * sizeof(void *) +
+	       uint64_t(m.size()) * (sizeof(std::pair<const K, V>) + 2 * sizeof(void *));
+}
+
 struct Instruction
 {
 	uint16_t op = 0;
-	uint16_t count = 0;
+	// Operand words, not counting the opcode word. Instructions have at most 65535 words, so 16 bits are enough.
+	uint16_t length = 0;
 	uint32_t offset = 0;
-	uint32_t length = 0;
+};
+
+// A block's elements in one of the arrays ParsedIR shares between all blocks.
+struct BlockSpan
+{
+	uint32_t offset = 0;
+	uint32_t count = 0;
+
+	bool empty() const
+	{
+		return count == 0;
+	}
+};
+
+// Read-only view of contiguous elements, so spans can be walked with range-based for loops.
+template <typename T>
+struct ArrayView
+{
+	const T *first = nullptr;
+	const T *last = nullptr;
+
+	const T *begin() const
+	{
+		return first;
+	}
+
+	const T *end() const
+	{
+		return last;
+	}
+
+	size_t size() const
+	{
+		return size_t(last - first);
+	}
+
+	bool empty() const
+	{
+		return first == last;
+	}
+
+	const T &operator[](size_t index) const
+	{
+		return first[index];
+	}
 };
 
 // Helper for Variant interface.
@@ -567,6 +649,9 @@ struct SPIRExpression : IVariant
 	// A list of expressions which this expression depends on.
 	std::vector<uint32_t> expression_dependencies;
 
+	// The last dependency registered in Compiler::flush_dependencies plus one, 0 if there is none.
+	uint32_t flush_dependency = 0;
+
 	SPIRV_CROSS_DECLARE_CLONE(SPIRExpression)
 };
 
@@ -667,7 +752,8 @@ struct SPIRBlock : IVariant
 	uint32_t false_block = 0;
 	uint32_t default_block = 0;
 
-	std::vector<Instruction> ops;
+	// Elements of ParsedIR::block_ops, see ParsedIR::get_ops().
+	BlockSpan ops;
 
 	struct Phi
 	{
@@ -677,7 +763,8 @@ struct SPIRBlock : IVariant
 	};
 
 	// Before entering this block flush out local variables to magical "phi" variables.
-	std::vector<Phi> phi_variables;
+	// Elements of ParsedIR::block_phis, see ParsedIR::get_phis().
+	BlockSpan phi_variables;
 
 	// Declare these temporaries before beginning the block.
 	// Used for handling complex continue blocks which have side effects.
@@ -692,7 +779,8 @@ struct SPIRBlock : IVariant
 		uint32_t value;
 		uint32_t block;
 	};
-	std::vector<Case> cases;
+	// Elements of ParsedIR::block_cases, see ParsedIR::get_cases().
+	BlockSpan cases;
 
 	// If we have tried to optimize code for this block but failed,
 	// keep track of this.
@@ -717,11 +805,6 @@ struct SPIRBlock : IVariant
 	// we remove these variables, and fall back to regular variables outside the loop.
 	std::vector<uint32_t> loop_variables;
 
-	// Some expressions are control-flow dependent, i.e. any instruction which relies on derivatives or
-	// sub-group-like operations.
-	// Make sure that we only use these expressions in the original block.
-	std::vector<uint32_t> invalidate_expressions;
-
 	SPIRV_CROSS_DECLARE_CLONE(SPIRBlock)
 };
 
@@ -880,8 +963,6 @@ struct SPIRVariable : IVariant
 	bool statically_assigned = false;
 	uint32_t static_expression = 0;
 
-	// Temporaries which can remain forwarded as long as this variable is not modified.
-	std::vector<uint32_t> dependees;
 	bool forwardable = true;
 
 	bool deferred_declaration = false;
@@ -19,6 +19,7 @@
 #include "spirv_cfg.hpp"
 #include "spirv_parser.hpp"
 #include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <utility>
 
@@ -29,14 +30,18 @@ using namespace spirv_cross;
 Compiler::Compiler(vector<uint32_t> ir_)
 {
 	Parser parser(move(ir_));
+	uint64_t start_ns = get_current_time_ns();
 	parser.parse();
+	stats.phase_ns[CompilerPhaseParse] += get_current_time_ns() - start_ns;
 	set_ir(move(parser.get_parsed_ir()));
 }
 
 Compiler::Compiler(const uint32_t *ir_, size_t word_count)
 {
 	Parser parser(ir_, word_count);
+	uint64_t start_ns = get_current_time_ns();
 	parser.parse();
+	stats.phase_ns[CompilerPhaseParse] += get_current_time_ns() - start_ns;
 	set_ir(move(parser.get_parsed_ir()));
 }
 
@@ -62,6 +67,420 @@ void Compiler::set_ir(const ParsedIR &ir_)
 	parse_fixup();
 }
 
+void Compiler::reset_module(vector<uint32_t> spirv)
+{
+	Parser parser(move(ir), move(spirv));
+	reset_module(parser);
+}
+
+void Compiler::reset_module(const uint32_t *spirv, size_t word_count)
+{
+	Parser parser(move(ir), spirv, word_count);
+	reset_module(parser);
+}
+
+void Compiler::reset_module(Parser &parser)
+{
+	invalidate_declared_layouts();
+	global_variables.clear();
+	aliased_variables.clear();
+	current_function = nullptr;
+	current_block = nullptr;
+	active_interface_variables.clear();
+	check_active_interface_variables = false;
+	flushes.clear();
+	flush_dependencies.clear();
+	force_recompile = false;
+	combined_image_samplers.clear();
+	global_struct_cache.clear();
+	variable_remap_callback = nullptr;
+	forced_temporaries.clear();
+	forwarded_temporaries.clear();
+	hoisted_temporaries.clear();
+	active_input_builtins.reset();
+	active_output_builtins.reset();
+	clip_distance_count = 0;
+	cull_distance_count = 0;
+	position_invariant = false;
+	comparison_ids.clear();
+	need_subpass_input = false;
+	dummy_sampler_id = 0;
+	function_cfgs.clear();
+	structural_queries.clear();
+	declared_block_names.clear();
+
+	uint64_t start_ns = get_current_time_ns();
+	parser.parse();
+	stats.phase_ns[CompilerPhaseParse] += get_current_time_ns() - start_ns;
+	set_ir(move(parser.get_parsed_ir()));
+}
+
+uint64_t Compiler::get_current_time_ns()
+{
+	auto now = chrono::steady_clock::now().time_since_epoch();
+	return uint64_t(chrono::duration_cast<chrono::nanoseconds>(now).count());
+}
+
+const char *spirv_cross::compiler_phase_name(CompilerPhase phase)
+{
+	switch (phase)
+	{
+	case CompilerPhaseParse:
+		return "parse";
+	case CompilerPhaseParseFixup:
+		return "parse_fixup";
+	case CompilerPhaseBuildCFG:
+		return "build_cfg";
+	case CompilerPhaseAnalyzeVariableScope:
+		return "analyze_variable_scope";
+	case CompilerPhaseFindFunctionLocalLUTs:
+		return "find_function_local_luts";
+	case CompilerPhaseUpdateActiveBuiltins:
+		return "update_active_builtins";
+	case CompilerPhaseAnalyzeImageAndSamplerUsage:
+		return "analyze_image_and_sampler_usage";
+	case CompilerPhaseFindStaticExtensions:
+		return "find_static_extensions";
+	case CompilerPhaseEmitResources:
+		return "emit_resources";
+	case CompilerPhaseEmitFunction:
+		return "emit_function";
+	default:
+		return "unknown";
+	}
+}
+
+Compiler::PhaseScope::PhaseScope(const Compiler &compiler, CompilerPhase phase_)
+    : stats(compiler.stats_enabled ? &compiler.stats : nullptr)
+    , trace(compiler.trace)
+    , phase(phase_)
+{
+	if (stats || trace)
+		start_ns = get_current_time_ns();
+}
+
+Compiler::PhaseScope::~PhaseScope()
+{
+	if (!stats && !trace)
+		return;
+
+	uint64_t end_ns = get_current_time_ns();
+	if (stats)
+		stats->phase_ns[phase] += end_ns - start_ns;
+	if (trace)
+		trace->add_event(compiler_phase_name(phase), "phase", start_ns, end_ns);
+}
+
+Compiler::TraceScope::TraceScope(const Compiler &compiler, const char *category_, const char *name_)
+    : trace(compiler.trace)
+    , category(category_)
+    , name(name_)
+{
+	if (trace)
+		start_ns = get_current_time_ns();
+}
+
+Compiler::TraceScope::~TraceScope()
+{
+	if (trace)
+		trace->add_event(name, category, start_ns, get_current_time_ns(), move(args));
+}
+
+void Compiler::TraceScope::add_arg(const char *key, uint32_t value)
+{
+	if (!args.empty())
+		args += ",";
+	args += join("\"", key, "\":", value);
+}
+
+void Compiler::TraceScope::add_arg(const char *key, const string &value)
+{
+	if (!args.empty())
+		args += ",";
+	args += join("\"", key, "\":\"", TraceRecorder::escape_json(value), "\"");
+}
+
+void Compiler::reset_stats()
+{
+	uint32_t id_count = stats.id_count;
+	uint32_t block_count = stats.block_count;
+	stats = {};
+	stats.id_count = id_count;
+	stats.block_count = block_count;
+	memory_high_water_mark = 0;
+}
+
+static uint64_t decoration_heap_size(const Meta::Decoration &dec)
+{
+	return heap_size(dec.alias) + heap_size(dec.qualified_alias) + heap_size(dec.hlsl_semantic);
+}
+
+static uint64_t variant_heap_size(const Variant &id)
+{
+	switch (id.get_type())
+	{
+	case TypeType:
+	{
+		auto &type = id.get<SPIRType>();
+		uint64_t size = sizeof(SPIRType) + heap_size(type.array) + heap_size(type.array_size_literal) +
+		                heap_size(type.member_types) + heap_size(type.member_name_cache);
+		for (auto &name : type.member_name_cache)
+			size += heap_size(name);
+		return size;
+	}
+
+	case TypeVariable:
+	{
+		auto &var = id.get<SPIRVariable>();
+		return sizeof(SPIRVariable) + heap_size(var.dereference_chain);
+	}
+
+	case TypeConstant:
+	{
+		auto &c = id.get<SPIRConstant>();
+		return sizeof(SPIRConstant) + heap_size(c.subconstants) + heap_size(c.specialization_constant_macro_name);
+	}
+
+	case TypeFunction:
+	{
+		auto &func = id.get<SPIRFunction>();
+		return sizeof(SPIRFunction) + heap_size(func.arguments) + heap_size(func.shadow_arguments) +
+		       heap_size(func.local_variables) + heap_size(func.blocks) + heap_size(func.combined_parameters) +
+		       heap_size(func.fixup_hooks_out) + heap_size(func.fixup_hooks_in);
+	}
+
+	case TypeFunctionPrototype:
+		return sizeof(SPIRFunctionPrototype) + heap_size(id.get<SPIRFunctionPrototype>().parameter_types);
+
+	case TypeBlock:
+	{
+		auto &block = id.get<SPIRBlock>();
+		return sizeof(SPIRBlock) + heap_size(block.declare_temporary) + heap_size(block.potential_declare_temporary) +
+		       heap_size(block.dominated_variables) + heap_size(block.loop_variables);
+	}
+
+	case TypeExtension:
+		return sizeof(SPIRExtension);
+
+	case TypeExpression:
+	{
+		auto &expr = id.get<SPIRExpression>();
+		return sizeof(SPIRExpression) + heap_size(expr.expression) + heap_size(expr.expression_dependencies);
+	}
+
+	case TypeConstantOp:
+		return sizeof(SPIRConstantOp) + heap_size(id.get<SPIRConstantOp>().arguments);
+
+	case TypeCombinedImageSampler:
+		return sizeof(SPIRCombinedImageSampler);
+
+	case TypeAccessChain:
+	{
+		auto &chain = id.get<SPIRAccessChain>();
+		return sizeof(SPIRAccessChain) + heap_size(chain.base) + heap_size(chain.dynamic_index);
+	}
+
+	case TypeUndef:
+		return sizeof(SPIRUndef);
+
+	default:
+		return 0;
+	}
+}
+
+CompilerMemoryFootprint Compiler::get_memory_footprint() const
+{
+	CompilerMemoryFootprint footprint = {};
+	append_memory_footprint(footprint);
+
+	footprint.total = footprint.spirv + footprint.meta + footprint.block_meta + footprint.cfgs +
+	                  footprint.name_caches + footprint.function_overloads + footprint.expression_usage_counts +
+	                  footprint.output_buffer;
+	for (auto size : footprint.ids)
+		footprint.total += size;
+
+	footprint.high_water_mark = max(memory_high_water_mark, footprint.total);
+	return footprint;
+}
+
+void Compiler::append_memory_footprint(CompilerMemoryFootprint &footprint) const
+{
+	footprint.spirv = heap_size(ir.spirv);
+
+	footprint.ids[TypeNone] = heap_size(ir.ids);
+	for (auto &id : ir.ids)
+		footprint.ids[id.get_type()] += variant_heap_size(id);
+	footprint.ids[TypeBlock] += heap_size(ir.block_ops) + heap_size(ir.block_phis) + heap_size(ir.block_cases);
+	footprint.ids[TypeFunction] += heap_size(ir.unparsed_functions);
+
+	footprint.meta = heap_size(ir.meta);
+	for (auto &meta : ir.meta)
+	{
+		footprint.meta += decoration_heap_size(meta.decoration) + heap_size(meta.members) +
+		                  heap_size(meta.decoration_word_offset);
+		for (auto &member : meta.members)
+			footprint.meta += decoration_heap_size(member);
+	}
+
+	footprint.block_meta = heap_size(ir.block_meta) + heap_size(ir.continue_block_to_loop_header);
+
+	footprint.cfgs = heap_size(function_cfgs) + heap_size(structural_queries.outside_flow_control) +
+	                 heap_size(structural_queries.continue_block_types);
+	for (auto &cfg : function_cfgs)
+		footprint.cfgs += sizeof(CFG) + cfg.second->get_heap_size();
+}
+
+void Compiler::update_memory_high_water_mark()
+{
+	memory_high_water_mark = max(memory_high_water_mark, get_memory_footprint().total);
+}
+
+static void append_bitset(CompileCacheKey &key, const Bitset &bits)
+{
+	uint32_t count = 0;
+	bits.for_each_bit([&](uint32_t) { count++; });
+	key.u32(count);
+	bits.for_each_bit([&](uint32_t bit) { key.u32(bit); });
+}
+
+static void append_decoration(CompileCacheKey &key, const Meta::Decoration &dec, bool layout_values)
+{
+	key.str(dec.alias);
+	key.str(dec.qualified_alias);
+	key.str(dec.hlsl_semantic);
+	append_bitset(key, dec.decoration_flags);
+	key.u32(dec.builtin_type);
+	key.u32(layout_values ? dec.location : 0);
+	key.u32(dec.component);
+	key.u32(layout_values ? dec.set : 0);
+	key.u32(layout_values ? dec.binding : 0);
+	key.u32(dec.offset);
+	key.u32(dec.array_stride);
+	key.u32(dec.matrix_stride);
+	key.u32(dec.input_attachment);
+	key.u32(dec.spec_id);
+	key.u32(dec.index);
+	key.u32(dec.builtin);
+}
+
+// Most IDs have no decorations at all, a single word is enough for those.
+static bool is_default_meta(const Meta &meta)
+{
+	auto &dec = meta.decoration;
+	return meta.members.empty() && dec.alias.empty() && dec.qualified_alias.empty() && dec.hlsl_semantic.empty() &&
+	       dec.decoration_flags.empty() && dec.builtin_type == BuiltInPosition && dec.location == 0 &&
+	       dec.component == 0 && dec.set == 0 && dec.binding == 0 && dec.offset == 0 && dec.array_stride == 0 &&
+	       dec.matrix_stride == 0 && dec.input_attachment == 0 && dec.spec_id == 0 && dec.index == 0 &&
+	       !dec.builtin;
+}
+
+string Compiler::get_compile_cache_key() const
+{
+	return build_compile_cache_key(true, true);
+}
+
+string Compiler::build_compile_cache_key(bool layout_values, bool hashed) const
+{
+	// A callback may return anything, so there is nothing to base a key on.
+	if (variable_remap_callback)
+		return "";
+
+	CompileCacheKey key(hashed);
+	append_compile_cache_key(key, layout_values);
+	return key.get();
+}
+
+void Compiler::append_compile_cache_key(CompileCacheKey &key, bool layout_values) const
+{
+	key.str("spirv_cross");
+	key.u32(CompileCacheFormatVersion);
+	key.words(ir.spirv.data(), ir.spirv.size());
+
+	// Decorations and names, including the ones set through the API.
+	key.u32(uint32_t(ir.meta.size()));
+	for (auto &meta : ir.meta)
+	{
+		bool is_default = is_default_meta(meta);
+		key.u32(is_default);
+		if (is_default)
+			continue;
+
+		append_decoration(key, meta.decoration, layout_values);
+		key.u32(uint32_t(meta.members.size()));
+		for (auto &member : meta.members)
+			append_decoration(key, member, layout_values);
+	}
+
+	// Constant values can be changed through get_constant(), variables can be remapped.
+	// Everything else in the IR derives from the module and the calls which are hashed below,
+	// or is left behind by an earlier compile, like the expressions of its IDs.
+	key.u32(uint32_t(ir.ids.size()));
+	for (auto &id : ir.ids)
+	{
+		bool keyed = id.get_type() == TypeConstant || id.get_type() == TypeVariable;
+		key.u32(keyed ? uint32_t(id.get_type()) : uint32_t(TypeNone));
+		if (id.get_type() == TypeConstant)
+		{
+			auto &c = id.get<SPIRConstant>();
+			key.u32(c.constant_type);
+			key.u32(c.specialization);
+			key.u32(c.m.columns);
+			for (uint32_t col = 0; col < c.m.columns; col++)
+			{
+				key.u32(c.m.c[col].vecsize);
+				for (uint32_t row = 0; row < c.m.c[col].vecsize; row++)
+					key.u64(c.m.c[col].r[row].u64);
+			}
+			key.words(c.subconstants.data(), c.subconstants.size());
+		}
+		else if (id.get_type() == TypeVariable)
+		{
+			auto &var = id.get<SPIRVariable>();
+			key.u32(var.remapped_variable);
+			key.u32(var.remapped_components);
+		}
+	}
+
+	// unordered_map, so visit the entry points in ID order.
+	vector<uint32_t> entry_point_ids;
+	for (auto &entry : ir.entry_points)
+		entry_point_ids.push_back(entry.first);
+	sort(begin(entry_point_ids), end(entry_point_ids));
+
+	key.u32(ir.default_entry_point);
+	key.u32(uint32_t(entry_point_ids.size()));
+	for (auto entry_id : entry_point_ids)
+	{
+		auto &entry = ir.entry_points.find(entry_id)->second;
+		// Not the name, the GLSL backend renames the entry point to main when it compiles.
+		key.u32(entry.self);
+		key.str(entry.orig_name);
+		key.u32(entry.model);
+		key.words(entry.interface_variables.data(), entry.interface_variables.size());
+		append_bitset(key, entry.flags);
+		key.u32(entry.workgroup_size.x);
+		key.u32(entry.workgroup_size.y);
+		key.u32(entry.workgroup_size.z);
+		key.u32(entry.workgroup_size.constant);
+		key.u32(entry.invocations);
+		key.u32(entry.output_vertices);
+	}
+
+	key.u32(check_active_interface_variables);
+	vector<uint32_t> active_variables(begin(active_interface_variables), end(active_interface_variables));
+	sort(begin(active_variables), end(active_variables));
+	key.words(active_variables.data(), active_variables.size());
+
+	key.u32(dummy_sampler_id);
+	key.u32(uint32_t(combined_image_samplers.size()));
+	for (auto &combined : combined_image_samplers)
+	{
+		key.u32(combined.combined_id);
+		key.u32(combined.image_id);
+		key.u32(combined.sampler_id);
+	}
+}
+
 string Compiler::compile()
 {
 	// Force a classic "C" locale, reverts when function returns
@@ -88,7 +507,7 @@ bool Compiler::variable_storage_is_aliased(const SPIRVariable &v)
 
 bool Compiler::block_is_pure(const SPIRBlock &block)
 {
-	for (auto &i : block.ops)
+	for (auto &i : ir.get_ops(block))
 	{
 		auto ops = stream(i);
 		auto op = static_cast<Op>(i.op);
@@ -182,22 +601,31 @@ string Compiler::to_name(uint32_t id, bool allow_alias) const
 
 bool Compiler::function_is_pure(const SPIRFunction &func)
 {
+	return get_function_summary(func).pure;
+}
+
+const Compiler::FunctionSummary &Compiler::get_function_summary(const SPIRFunction &func)
+{
+	auto itr = function_summaries.find(func.self);
+	if (itr != end(function_summaries))
+		return itr->second;
+
+	// Callees are summarized first, block_is_pure() looks them up as well.
+	FunctionSummary summary;
 	for (auto block : func.blocks)
 	{
-		if (!block_is_pure(get<SPIRBlock>(block)))
-		{
-			//fprintf(stderr, "Function %s is impure!\n", to_name(func.self).c_str());
-			return false;
-		}
+		auto &b = get<SPIRBlock>(block);
+		add_global_reads(b, summary);
+		if (summary.pure && !block_is_pure(b))
+			summary.pure = false;
 	}
 
-	//fprintf(stderr, "Function %s is pure!\n", to_name(func.self).c_str());
-	return true;
+	return function_summaries[func.self] = move(summary);
 }
 
-void Compiler::register_global_read_dependencies(const SPIRBlock &block, uint32_t id)
+void Compiler::add_global_reads(const SPIRBlock &block, FunctionSummary &summary)
 {
-	for (auto &i : block.ops)
+	for (auto &i : ir.get_ops(block))
 	{
 		auto ops = stream(i);
 		auto op = static_cast<Op>(i.op);
@@ -206,8 +634,8 @@ void Compiler::register_global_read_dependencies(const SPIRBlock &block, uint32_
 		{
 		case OpFunctionCall:
 		{
-			uint32_t func = ops[2];
-			register_global_read_dependencies(get<SPIRFunction>(func), id);
+			auto &callee = get_function_summary(get<SPIRFunction>(ops[2]));
+			summary.global_reads.insert(begin(callee.global_reads), end(callee.global_reads));
 			break;
 		}
 
@@ -222,7 +650,7 @@ void Compiler::register_global_read_dependencies(const SPIRBlock &block, uint32_
 
 				// InputTargets are immutable.
 				if (type.basetype != SPIRType::Image && type.image.dim != DimSubpassData)
-					var->dependees.push_back(id);
+					summary.global_reads.insert(var->self);
 			}
 			break;
 		}
@@ -235,8 +663,9 @@ void Compiler::register_global_read_dependencies(const SPIRBlock &block, uint32_
 
 void Compiler::register_global_read_dependencies(const SPIRFunction &func, uint32_t id)
 {
-	for (auto block : func.blocks)
-		register_global_read_dependencies(get<SPIRBlock>(block), id);
+	auto &expr = get<SPIRExpression>(id);
+	for (auto var : get_function_summary(func).global_reads)
+		register_flush_dependency(expr, get<SPIRVariable>(var));
 }
 
 SPIRVariable *Compiler::maybe_get_backing_variable(uint32_t chain)
@@ -267,7 +696,7 @@ void Compiler::register_read(uint32_t expr, uint32_t chain, bool forwarded)
 
 		// If the backing variable is immutable, we do not need to depend on the variable.
 		if (forwarded && !is_immutable(var->self))
-			var->dependees.push_back(e.self);
+			register_flush_dependency(e, *var);
 
 		// If we load from a parameter, make sure we create "inout" if we also write to the parameter.
 		// The default is "in" however, so we never invalidate our compilation by reading.
@@ -298,7 +727,7 @@ void Compiler::register_write(uint32_t chain)
 		if (variable_storage_is_aliased(*var))
 			flush_all_aliased_variables();
 		else if (var)
-			flush_dependees(*var);
+			flush_variable(*var);
 
 		// We tried to write to a parameter which is not marked with out qualifier, force a recompile.
 		if (var->parameter && var->parameter->write_count == 0)
@@ -309,46 +738,95 @@ void Compiler::register_write(uint32_t chain)
 	}
 }
 
-void Compiler::flush_dependees(SPIRVariable &var)
+void Compiler::FlushState::clear()
+{
+	count = 0;
+	function_variables = 0;
+	global_variables = 0;
+	aliased_variables = 0;
+	ids.clear();
+}
+
+void Compiler::FlushState::flush_id(uint32_t id)
+{
+	if (id >= ids.size())
+		ids.resize(id + 1);
+	ids[id] = ++count;
+}
+
+uint32_t Compiler::get_flush_classes(const SPIRVariable &var)
+{
+	uint32_t classes = 0;
+	if (var.storage == StorageClassFunction)
+		classes |= FlushClassFunctionBit;
+	if (var.storage == StorageClassPrivate || var.storage == StorageClassWorkgroup || var.storage == StorageClassOutput)
+		classes |= FlushClassGlobalBit;
+	if (variable_storage_is_aliased(var))
+		classes |= FlushClassAliasedBit;
+	return classes;
+}
+
+void Compiler::register_flush_dependency(SPIRExpression &expr, uint32_t id, uint32_t flush_classes)
+{
+	flush_dependencies.push_back({ id, flushes.count, flush_classes, expr.flush_dependency });
+	expr.flush_dependency = uint32_t(flush_dependencies.size());
+}
+
+void Compiler::register_flush_dependency(SPIRExpression &expr, const SPIRVariable &var)
+{
+	register_flush_dependency(expr, var.self, get_flush_classes(var));
+}
+
+bool Compiler::expression_is_invalidated(const SPIRExpression &expr) const
+{
+	for (uint32_t index = expr.flush_dependency; index != 0;)
+	{
+		auto &dep = flush_dependencies[index - 1];
+		index = dep.next;
+
+		// Nothing was flushed since.
+		if (dep.flush_count == flushes.count)
+			continue;
+
+		if ((dep.flush_classes & FlushClassFunctionBit) != 0 && flushes.function_variables > dep.flush_count)
+			return true;
+		if ((dep.flush_classes & FlushClassGlobalBit) != 0 && flushes.global_variables > dep.flush_count)
+			return true;
+		if ((dep.flush_classes & FlushClassAliasedBit) != 0 && flushes.aliased_variables > dep.flush_count)
+			return true;
+
+		if (dep.id < flushes.ids.size() && flushes.ids[dep.id] > dep.flush_count)
+			return true;
+	}
+
+	return false;
+}
+
+void Compiler::flush_variable(const SPIRVariable &var)
 {
-	for (auto expr : var.dependees)
-		invalid_expressions.insert(expr);
-	var.dependees.clear();
+	flushes.flush_id(var.self);
 }
 
 void Compiler::flush_all_aliased_variables()
 {
-	for (auto aliased : aliased_variables)
-		flush_dependees(get<SPIRVariable>(aliased));
+	flushes.aliased_variables = ++flushes.count;
 }
 
 void Compiler::flush_all_atomic_capable_variables()
 {
-	for (auto global : global_variables)
-		flush_dependees(get<SPIRVariable>(global));
-	flush_all_aliased_variables();
+	flushes.global_variables = flushes.aliased_variables = ++flushes.count;
 }
 
 void Compiler::flush_control_dependent_expressions(uint32_t block_id)
 {
-	auto &block = get<SPIRBlock>(block_id);
-	for (auto &expr : block.invalidate_expressions)
-		invalid_expressions.insert(expr);
-	block.invalidate_expressions.clear();
+	flushes.flush_id(block_id);
 }
 
 void Compiler::flush_all_active_variables()
 {
 	// Invalidate all temporaries we read from variables in this block since they were forwarded.
 	// Invalidate all temporaries we read from globals.
-	for (auto &v : current_function->local_variables)
-		flush_dependees(get<SPIRVariable>(v));
-	for (auto &arg : current_function->arguments)
-		flush_dependees(get<SPIRVariable>(arg.id));
-	for (auto global : global_variables)
-		flush_dependees(get<SPIRVariable>(global));
-
-	flush_all_aliased_variables();
+	flushes.function_variables = flushes.global_variables = flushes.aliased_variables = ++flushes.count;
 }
 
 uint32_t Compiler::expression_type_id(uint32_t id) const
@@ -782,6 +1260,14 @@ void Compiler::fixup_type_alias()
 	// Due to how some backends work, the "master" type of type_alias must be a block-like type if it exists.
 	// FIXME: Multiple alias types which are both block-like will be awkward, for now, it's best to just drop the type
 	// alias if the slave type is a block type.
+
+	// Types which may alias a type, so becoming the master does not need to look at every ID.
+	// Entries go stale when an alias changes, so the alias is checked again before it is used.
+	unordered_map<uint32_t, vector<uint32_t>> aliases;
+	for (auto &id : ir.ids)
+		if (id.get_type() == TypeType && id.get<SPIRType>().type_alias)
+			aliases[id.get<SPIRType>().type_alias].push_back(id.get_id());
+
 	for (auto &id : ir.ids)
 	{
 		if (id.get_type() != TypeType)
@@ -792,19 +1278,23 @@ void Compiler::fixup_type_alias()
 		if (type.type_alias && type_is_block_like(type))
 		{
 			// Become the master.
-			for (auto &other_id : ir.ids)
+			vector<uint32_t> others;
+			swap(others, aliases[type.type_alias]);
+			for (auto other : others)
 			{
-				if (other_id.get_type() != TypeType)
-					continue;
-				if (other_id.get_id() == type.self)
+				if (other == type.self)
 					continue;
 
-				auto &other_type = other_id.get<SPIRType>();
+				auto &other_type = get<SPIRType>(other);
 				if (other_type.type_alias == type.type_alias)
+				{
 					other_type.type_alias = type.self;
+					aliases[type.self].push_back(other);
+				}
 			}
 
 			get<SPIRType>(type.type_alias).type_alias = id.get_id();
+			aliases[id.get_id()].push_back(type.type_alias);
 			type.type_alias = 0;
 		}
 	}
@@ -823,12 +1313,67 @@ void Compiler::fixup_type_alias()
 	}
 }
 
+void Compiler::parse_reachable_functions(uint32_t entry)
+{
+	if (ir.unparsed_functions.empty())
+		return;
+
+	uint64_t start_ns = get_current_time_ns();
+	vector<uint32_t> parsed;
+
+	// The IR is handed back even if parsing fails, so the compiler stays usable.
+	struct IRReturn
+	{
+		ParsedIR &ir;
+		Parser &parser;
+
+		~IRReturn()
+		{
+			ir = move(parser.get_parsed_ir());
+		}
+	};
+
+	{
+		Parser parser(move(ir));
+		IRReturn ir_return = { ir, parser };
+		parsed = parser.parse_function(entry);
+	}
+
+	// parse_fixup() has seen the variables of the other functions already.
+	for (auto function : parsed)
+	{
+		auto &func = get<SPIRFunction>(function);
+		stats.block_count += uint32_t(func.blocks.size());
+		for (auto &arg : func.arguments)
+			register_variable(get<SPIRVariable>(arg.id));
+		for (auto local : func.local_variables)
+			register_variable(get<SPIRVariable>(local));
+	}
+
+	stats.phase_ns[CompilerPhaseParse] += get_current_time_ns() - start_ns;
+}
+
+void Compiler::register_variable(const SPIRVariable &var)
+{
+	if (var.storage == StorageClassPrivate || var.storage == StorageClassWorkgroup ||
+	    var.storage == StorageClassOutput)
+		global_variables.push_back(var.self);
+	if (variable_storage_is_aliased(var))
+		aliased_variables.push_back(var.self);
+}
+
 void Compiler::parse_fixup()
 {
+	uint64_t start_ns = get_current_time_ns();
+	stats.id_count = uint32_t(ir.ids.size());
+	stats.block_count = 0;
+
 	// Figure out specialization constants for work group sizes.
 	for (auto &id : ir.ids)
 	{
-		if (id.get_type() == TypeConstant)
+		if (id.get_type() == TypeBlock)
+			stats.block_count++;
+		else if (id.get_type() == TypeConstant)
 		{
 			auto &c = id.get<SPIRConstant>();
 			if (ir.meta[c.self].decoration.builtin && ir.meta[c.self].decoration.builtin_type == BuiltInWorkgroupSize)
@@ -845,17 +1390,13 @@ void Compiler::parse_fixup()
 			}
 		}
 		else if (id.get_type() == TypeVariable)
-		{
-			auto &var = id.get<SPIRVariable>();
-			if (var.storage == StorageClassPrivate || var.storage == StorageClassWorkgroup ||
-			    var.storage == StorageClassOutput)
-				global_variables.push_back(var.self);
-			if (variable_storage_is_aliased(var))
-				aliased_variables.push_back(var.self);
-		}
+			register_variable(id.get<SPIRVariable>());
 	}
 
 	fixup_type_alias();
+	stats.phase_ns[CompilerPhaseParseFixup] += get_current_time_ns() - start_ns;
+
+	parse_reachable_functions(ir.default_entry_point);
 }
 
 void Compiler::flatten_interface_block(uint32_t id)
@@ -998,11 +1539,13 @@ void Compiler::set_member_decoration_string(uint32_t id, uint32_t index, spv::De
 void Compiler::set_member_decoration(uint32_t id, uint32_t index, Decoration decoration, uint32_t argument)
 {
 	ir.set_member_decoration(id, index, decoration, argument);
+	invalidate_declared_layouts();
 }
 
 void Compiler::set_member_name(uint32_t id, uint32_t index, const std::string &name)
 {
 	ir.set_member_name(id, index, name);
+	invalidate_declared_layouts();
 }
 
 const std::string &Compiler::get_member_name(uint32_t id, uint32_t index) const
@@ -1050,6 +1593,7 @@ bool Compiler::has_member_decoration(uint32_t id, uint32_t index, Decoration dec
 void Compiler::unset_member_decoration(uint32_t id, uint32_t index, Decoration decoration)
 {
 	ir.unset_member_decoration(id, index, decoration);
+	invalidate_declared_layouts();
 }
 
 void Compiler::set_decoration_string(uint32_t id, spv::Decoration decoration, const std::string &argument)
@@ -1060,6 +1604,7 @@ void Compiler::set_decoration_string(uint32_t id, spv::Decoration decoration, co
 void Compiler::set_decoration(uint32_t id, Decoration decoration, uint32_t argument)
 {
 	ir.set_decoration(id, decoration, argument);
+	invalidate_declared_layouts();
 }
 
 StorageClass Compiler::get_storage_class(uint32_t id) const
@@ -1119,6 +1664,7 @@ uint32_t Compiler::get_decoration(uint32_t id, Decoration decoration) const
 void Compiler::unset_decoration(uint32_t id, Decoration decoration)
 {
 	ir.unset_decoration(id, decoration);
+	invalidate_declared_layouts();
 }
 
 bool Compiler::get_binary_offset_for_decoration(uint32_t id, spv::Decoration decoration, uint32_t &word_offset) const
@@ -1156,13 +1702,13 @@ bool Compiler::block_is_loop_candidate(const SPIRBlock &block, SPIRBlock::Method
 		// so we cannot assume this is a for loop candidate.
 		if (ret)
 		{
-			for (auto &phi : block.phi_variables)
+			for (auto &phi : ir.get_phis(block))
 				if (phi.parent == block.self)
 					return false;
 
 			auto *merge = maybe_get<SPIRBlock>(block.merge_block);
 			if (merge)
-				for (auto &phi : merge->phi_variables)
+				for (auto &phi : ir.get_phis(*merge))
 					if (phi.parent == block.self)
 						return false;
 		}
@@ -1187,17 +1733,17 @@ bool Compiler::block_is_loop_candidate(const SPIRBlock &block, SPIRBlock::Method
 		// so we cannot assume this is a for loop candidate.
 		if (ret)
 		{
-			for (auto &phi : block.phi_variables)
+			for (auto &phi : ir.get_phis(block))
 				if (phi.parent == block.self || phi.parent == child.self)
 					return false;
 
-			for (auto &phi : child.phi_variables)
+			for (auto &phi : ir.get_phis(child))
 				if (phi.parent == block.self)
 					return false;
 
 			auto *merge = maybe_get<SPIRBlock>(block.merge_block);
 			if (merge)
-				for (auto &phi : merge->phi_variables)
+				for (auto &phi : ir.get_phis(*merge))
 					if (phi.parent == block.self || phi.parent == child.false_block)
 						return false;
 		}
@@ -1208,6 +1754,17 @@ bool Compiler::block_is_loop_candidate(const SPIRBlock &block, SPIRBlock::Method
 		return false;
 }
 
+static inline uint64_t block_pair_key(uint32_t a, uint32_t b)
+{
+	return (uint64_t(a) << 32) | b;
+}
+
+void Compiler::StructuralQueryCache::clear()
+{
+	outside_flow_control.clear();
+	continue_block_types.clear();
+}
+
 bool Compiler::block_is_outside_flow_control_from_block(const SPIRBlock &from, const SPIRBlock &to)
 {
 	auto *start = &from;
@@ -1219,6 +1776,15 @@ bool Compiler::block_is_outside_flow_control_from_block(const SPIRBlock &from, c
 	if (is_continue(start->self))
 		return false;
 
+	// A loop header reaches its merge block both directly and through the loop condition,
+	// so without the cache, every loop in sequence would double the work.
+	uint64_t key = block_pair_key(start->self, to.self);
+	auto itr = structural_queries.outside_flow_control.find(key);
+	if (itr != end(structural_queries.outside_flow_control))
+		return itr->second;
+
+	bool outside;
+
 	// If our select block doesn't merge, we must break or continue in these blocks,
 	// so if continues occur branchless within these blocks, consider them branchless as well.
 	// This is typically used for loop control.
@@ -1226,18 +1792,21 @@ bool Compiler::block_is_outside_flow_control_from_block(const SPIRBlock &from, c
 	    (block_is_outside_flow_control_from_block(get<SPIRBlock>(start->true_block), to) ||
 	     block_is_outside_flow_control_from_block(get<SPIRBlock>(start->false_block), to)))
 	{
-		return true;
+		outside = true;
 	}
 	else if (start->merge_block && block_is_outside_flow_control_from_block(get<SPIRBlock>(start->merge_block), to))
 	{
-		return true;
+		outside = true;
 	}
 	else if (start->next_block && block_is_outside_flow_control_from_block(get<SPIRBlock>(start->next_block), to))
 	{
-		return true;
+		outside = true;
 	}
 	else
-		return false;
+		outside = false;
+
+	structural_queries.outside_flow_control[key] = outside;
+	return outside;
 }
 
 bool Compiler::execution_is_noop(const SPIRBlock &from, const SPIRBlock &to) const
@@ -1256,7 +1825,7 @@ bool Compiler::execution_is_noop(const SPIRBlock &from, const SPIRBlock &to) con
 
 		auto &next = get<SPIRBlock>(start->next_block);
 		// Flushing phi variables does not count as noop.
-		for (auto &phi : next.phi_variables)
+		for (auto &phi : ir.get_phis(next))
 			if (phi.parent == start->self)
 				return false;
 
@@ -1290,22 +1859,31 @@ SPIRBlock::ContinueBlockType Compiler::continue_block_type(const SPIRBlock &bloc
 	if (block.merge == SPIRBlock::MergeLoop)
 		return SPIRBlock::WhileLoop;
 
+	uint64_t key = block_pair_key(block.self, block.loop_dominator);
+	auto itr = structural_queries.continue_block_types.find(key);
+	if (itr != end(structural_queries.continue_block_types))
+		return itr->second;
+
 	auto &dominator = get<SPIRBlock>(block.loop_dominator);
+	SPIRBlock::ContinueBlockType type;
 
 	if (execution_is_noop(block, dominator))
-		return SPIRBlock::WhileLoop;
+		type = SPIRBlock::WhileLoop;
 	else if (execution_is_branchless(block, dominator))
-		return SPIRBlock::ForLoop;
+		type = SPIRBlock::ForLoop;
 	else
 	{
 		if (block.merge == SPIRBlock::MergeNone && block.terminator == SPIRBlock::Select &&
 		    block.true_block == dominator.self && block.false_block == dominator.merge_block)
 		{
-			return SPIRBlock::DoWhileLoop;
+			type = SPIRBlock::DoWhileLoop;
 		}
 		else
-			return SPIRBlock::ComplexLoop;
+			type = SPIRBlock::ComplexLoop;
 	}
+
+	structural_queries.continue_block_types[key] = type;
+	return type;
 }
 
 bool Compiler::traverse_all_reachable_opcodes(const SPIRBlock &block, OpcodeHandler &handler) const
@@ -1315,11 +1893,14 @@ bool Compiler::traverse_all_reachable_opcodes(const SPIRBlock &block, OpcodeHand
 	// Ideally, perhaps traverse the CFG instead of all blocks in order to eliminate dead blocks,
 	// but this shouldn't be a problem in practice unless the SPIR-V is doing insane things like recursing
 	// inside dead blocks ...
-	for (auto &i : block.ops)
+	for (auto &i : ir.get_ops(block))
 	{
 		auto ops = stream(i);
 		auto op = static_cast<Op>(i.op);
 
+		if (stats_enabled)
+			stats.opcodes_visited++;
+
 		if (!handler.handle(op, ops, i.length))
 			return false;
 
@@ -1343,6 +1924,10 @@ bool Compiler::traverse_all_reachable_opcodes(const SPIRBlock &block, OpcodeHand
 
 bool Compiler::traverse_all_reachable_opcodes(const SPIRFunction &func, OpcodeHandler &handler) const
 {
+	TraceScope scope(*this, "traverse", "traverse_function");
+	if (scope.is_active())
+		scope.add_arg("function", to_name(func.self));
+
 	for (auto block : func.blocks)
 		if (!traverse_all_reachable_opcodes(get<SPIRBlock>(block), handler))
 			return false;
@@ -1387,9 +1972,14 @@ size_t Compiler::get_declared_struct_size(const SPIRType &type) const
 	if (type.member_types.empty())
 		SPIRV_CROSS_THROW("Declared struct in block cannot be empty.");
 
+	auto itr = declared_struct_size_cache.find(type.self);
+	if (itr != end(declared_struct_size_cache))
+		return itr->second;
+
 	uint32_t last = uint32_t(type.member_types.size() - 1);
 	size_t offset = type_struct_member_offset(type, last);
 	size_t size = get_declared_struct_member_size(type, last);
+	declared_struct_size_cache[type.self] = offset + size;
 	return offset + size;
 }
 
@@ -1466,6 +2056,75 @@ size_t Compiler::get_declared_struct_member_size(const SPIRType &struct_type, ui
 	}
 }
 
+void Compiler::invalidate_declared_layouts()
+{
+	if (!declared_struct_size_cache.empty())
+		declared_struct_size_cache.clear();
+	if (!declared_buffer_layout_cache.empty())
+		declared_buffer_layout_cache.clear();
+}
+
+void Compiler::append_declared_struct_layout(const SPIRType &type, const string &prefix, uint32_t base_offset,
+                                             vector<BufferLayoutMember> &layout) const
+{
+	for (uint32_t i = 0; i < uint32_t(type.member_types.size()); i++)
+	{
+		auto &member_type = get<SPIRType>(type.member_types[i]);
+		auto &flags = get_member_decoration_bitset(type.self, i);
+
+		auto name = get_member_name(type.self, i);
+		if (name.empty())
+			name = get_fallback_member_name(i);
+
+		BufferLayoutMember member;
+		member.path = prefix + name;
+		member.type_id = type.member_types[i];
+		member.offset = base_offset + type_struct_member_offset(type, i);
+		member.size = uint32_t(get_declared_struct_member_size(type, i));
+		member.array_stride = member_type.array.empty() ? 0 : type_struct_member_array_stride(type, i);
+		member.matrix_stride = member_type.columns > 1 ? type_struct_member_matrix_stride(type, i) : 0;
+		member.row_major = flags.get(DecorationRowMajor);
+		member.basetype = member_type.basetype;
+		member.vecsize = member_type.vecsize;
+		member.columns = member_type.columns;
+		set_declared_member_packing(type, i, member);
+		layout.push_back(member);
+
+		if (member_type.basetype == SPIRType::Struct)
+		{
+			string member_prefix = member.path;
+			for (size_t j = 0; j < member_type.array.size(); j++)
+				member_prefix += "[0]";
+			member_prefix += ".";
+			append_declared_struct_layout(get<SPIRType>(member_type.self), member_prefix, member.offset, layout);
+		}
+	}
+}
+
+void Compiler::set_declared_member_packing(const SPIRType &, uint32_t, BufferLayoutMember &member) const
+{
+	member.std140_alignment = 0;
+	member.std430_alignment = 0;
+	member.std140_compliant = false;
+	member.std430_compliant = false;
+}
+
+vector<BufferLayoutMember> Compiler::get_declared_buffer_layout(uint32_t id) const
+{
+	auto &type = get<SPIRType>(expression_type(id).self);
+	if (type.basetype != SPIRType::Struct)
+		SPIRV_CROSS_THROW("Declared buffer layouts can only be queried for buffer blocks.");
+
+	auto itr = declared_buffer_layout_cache.find(type.self);
+	if (itr != end(declared_buffer_layout_cache))
+		return itr->second;
+
+	vector<BufferLayoutMember> layout;
+	append_declared_struct_layout(type, "", 0, layout);
+	declared_buffer_layout_cache[type.self] = layout;
+	return layout;
+}
+
 bool Compiler::BufferAccessHandler::handle(Op opcode, const uint32_t *args, uint32_t length)
 {
 	if (opcode != OpAccessChain && opcode != OpInBoundsAccessChain)
@@ -1701,7 +2360,7 @@ void Compiler::inherit_expression_dependencies(uint32_t dst, uint32_t source_exp
 	{
 		// We have used a phi variable, which can change at the end of the block,
 		// so make sure we take a dependency on this phi variable.
-		phi->dependees.push_back(dst);
+		register_flush_dependency(e, *phi);
 	}
 
 	auto *s = maybe_get<SPIRExpression>(source_expression);
@@ -1754,12 +2413,14 @@ void Compiler::set_entry_point(const std::string &name)
 {
 	auto &entry = get_first_entry_point(name);
 	ir.default_entry_point = entry.self;
+	parse_reachable_functions(entry.self);
 }
 
 void Compiler::set_entry_point(const std::string &name, spv::ExecutionModel model)
 {
 	auto &entry = get_entry_point(name, model);
 	ir.default_entry_point = entry.self;
+	parse_reachable_functions(entry.self);
 }
 
 SPIREntryPoint &Compiler::get_entry_point(const std::string &name)
@@ -2362,6 +3023,8 @@ vector<SpecializationConstant> Compiler::get_specialization_constants() const
 
 SPIRConstant &Compiler::get_constant(uint32_t id)
 {
+	// Specialization constants can size arrays in buffers.
+	invalidate_declared_layouts();
 	return get<SPIRConstant>(id);
 }
 
@@ -2370,28 +3033,13 @@ const SPIRConstant &Compiler::get_constant(uint32_t id) const
 	return get<SPIRConstant>(id);
 }
 
-static bool exists_unaccessed_path_to_return(const CFG &cfg, uint32_t block, const unordered_set<uint32_t> &blocks)
-{
-	// This block accesses the variable.
-	if (blocks.find(block) != end(blocks))
-		return false;
-
-	// We are at the end of the CFG.
-	if (cfg.get_succeeding_edges(block).empty())
-		return true;
-
-	// If any of our successors have a path to the end, there exists a path from block.
-	for (auto &succ : cfg.get_succeeding_edges(block))
-		if (exists_unaccessed_path_to_return(cfg, succ, blocks))
-			return true;
-
-	return false;
-}
-
 void Compiler::analyze_parameter_preservation(
     SPIRFunction &entry, const CFG &cfg, const unordered_map<uint32_t, unordered_set<uint32_t>> &variable_to_blocks,
     const unordered_map<uint32_t, unordered_set<uint32_t>> &complete_write_blocks)
 {
+	// Arguments which are completely written somewhere, and the blocks which write them.
+	vector<pair<SPIRFunction::Parameter *, const unordered_set<uint32_t> *>> written_args;
+
 	for (auto &arg : entry.arguments)
 	{
 		// Non-pointers are always inputs.
@@ -2434,15 +3082,68 @@ void Compiler::analyze_parameter_preservation(
 			continue;
 		}
 
-		// If there is a path through the CFG where no block completely writes to the variable, the variable will be in an undefined state
-		// when the function returns. We therefore need to implicitly preserve the variable in case there are writers in the function.
-		// Major case here is if a function is
-		// void foo(int &var) { if (cond) var = 10; }
-		// Using read/write counts, we will think it's just an out variable, but it really needs to be inout,
-		// because if we don't write anything whatever we put into the function must return back to the caller.
-		if (exists_unaccessed_path_to_return(cfg, entry.entry_block, itr->second))
-			arg.read_count++;
+		written_args.push_back(make_pair(&arg, &itr->second));
+	}
+
+	if (written_args.empty())
+		return;
+
+	// If there is a path through the CFG where no block completely writes to the variable, the variable will be in an undefined state
+	// when the function returns. We therefore need to implicitly preserve the variable in case there are writers in the function.
+	// Major case here is if a function is
+	// void foo(int &var) { if (cond) var = 10; }
+	// Using read/write counts, we will think it's just an out variable, but it really needs to be inout,
+	// because if we don't write anything whatever we put into the function must return back to the caller.
+
+	// Every block gets a bit per argument, set if there is a path from the block to a return which does not
+	// completely write the argument. Successors come first in post order, so one pass over the blocks
+	// finds the paths of all arguments at once, instead of enumerating paths per argument.
+	auto &post_order = cfg.get_post_order();
+	size_t words = (written_args.size() + 63) / 64;
+	vector<uint64_t> written(post_order.size() * words);
+	vector<uint64_t> unaccessed_path(post_order.size() * words);
+
+	for (size_t i = 0; i < written_args.size(); i++)
+	{
+		for (auto block : *written_args[i].second)
+			if (cfg.is_reachable(block))
+				written[(cfg.get_visit_order(block) - 1) * words + i / 64] |= 1ull << (i % 64);
 	}
+
+	for (size_t index = 0; index < post_order.size(); index++)
+	{
+		auto &succeeding_edges = cfg.get_succeeding_edges(post_order[index]);
+		uint64_t *paths = &unaccessed_path[index * words];
+
+		for (size_t word = 0; word < words; word++)
+		{
+			// We are at the end of the CFG.
+			if (succeeding_edges.empty())
+				paths[word] = ~uint64_t(0);
+
+			// If any of our successors have a path to the end, there exists a path from block.
+			for (auto succ : succeeding_edges)
+			{
+				if (cfg.is_reachable(succ))
+					paths[word] |= unaccessed_path[(cfg.get_visit_order(succ) - 1) * words + word];
+				else
+				{
+					// Loop merge targets which are never branched to have no successors.
+					for (size_t i = word * 64; i < min(written_args.size(), word * 64 + 64); i++)
+						if (!written_args[i].second->count(succ))
+							paths[word] |= 1ull << (i % 64);
+				}
+			}
+
+			// This block accesses the variable.
+			paths[word] &= ~written[index * words + word];
+		}
+	}
+
+	const uint64_t *entry_paths = &unaccessed_path[(cfg.get_visit_order(entry.entry_block) - 1) * words];
+	for (size_t i = 0; i < written_args.size(); i++)
+		if (entry_paths[i / 64] & (1ull << (i % 64)))
+			written_args[i].first->read_count++;
 }
 
 Compiler::AnalyzeVariableScopeAccessHandler::AnalyzeVariableScopeAccessHandler(Compiler &compiler_,
@@ -2468,7 +3169,7 @@ void Compiler::AnalyzeVariableScopeAccessHandler::set_current_block(const SPIRBl
 	// have a complete picture.
 	const auto test_phi = [this, &block](uint32_t to) {
 		auto &next = compiler.get<SPIRBlock>(to);
-		for (auto &phi : next.phi_variables)
+		for (auto &phi : compiler.ir.get_phis(next))
 		{
 			if (phi.parent == block.self)
 			{
@@ -2496,7 +3197,7 @@ void Compiler::AnalyzeVariableScopeAccessHandler::set_current_block(const SPIRBl
 
 	case SPIRBlock::MultiSelect:
 		notify_variable_access(block.condition, block.self);
-		for (auto &target : block.cases)
+		for (auto &target : compiler.ir.get_cases(block))
 			test_phi(target.block);
 		if (block.default_block)
 			test_phi(block.default_block);
@@ -2716,10 +3417,13 @@ bool Compiler::AnalyzeVariableScopeAccessHandler::handle(spv::Op op, const uint3
 	return true;
 }
 
-Compiler::StaticExpressionAccessHandler::StaticExpressionAccessHandler(Compiler &compiler_, uint32_t variable_id_)
+Compiler::StaticExpressionAccessHandler::StaticExpressionAccessHandler(Compiler &compiler_,
+                                                                       const vector<uint32_t> &variable_ids)
     : compiler(compiler_)
-    , variable_id(variable_id_)
+    , remaining(uint32_t(variable_ids.size()))
 {
+	for (auto id : variable_ids)
+		candidates[id];
 }
 
 bool Compiler::StaticExpressionAccessHandler::follow_function_call(const SPIRFunction &)
@@ -2729,44 +3433,68 @@ bool Compiler::StaticExpressionAccessHandler::follow_function_call(const SPIRFun
 
 bool Compiler::StaticExpressionAccessHandler::handle(spv::Op op, const uint32_t *args, uint32_t length)
 {
+	Candidate *candidate = nullptr;
 	switch (op)
 	{
 	case OpStore:
 		if (length < 2)
 			return false;
-		if (args[0] == variable_id)
+		candidate = find_candidate(args[0]);
+		if (candidate)
 		{
-			static_expression = args[1];
-			write_count++;
+			candidate->static_expression = args[1];
+			candidate->write_count++;
 		}
 		break;
 
 	case OpLoad:
 		if (length < 3)
 			return false;
-		if (args[2] == variable_id && static_expression == 0) // Tried to read from variable before it was initialized.
-			return false;
+		candidate = find_candidate(args[2]);
+		if (candidate && candidate->static_expression == 0) // Tried to read from variable before it was initialized.
+			finish(*candidate);
 		break;
 
 	case OpAccessChain:
 	case OpInBoundsAccessChain:
 		if (length < 3)
 			return false;
-		if (args[2] == variable_id) // If we try to access chain our candidate variable before we store to it, bail.
-			return false;
+		candidate = find_candidate(args[2]);
+		if (candidate) // If we try to access chain our candidate variable before we store to it, bail.
+			finish(*candidate);
 		break;
 
 	default:
 		break;
 	}
 
-	return true;
+	// Nothing left to find.
+	return remaining != 0;
+}
+
+Compiler::StaticExpressionAccessHandler::Candidate *Compiler::StaticExpressionAccessHandler::find_candidate(
+    uint32_t id)
+{
+	auto itr = candidates.find(id);
+	if (itr == end(candidates) || itr->second.done)
+		return nullptr;
+	return &itr->second;
+}
+
+void Compiler::StaticExpressionAccessHandler::finish(Candidate &candidate)
+{
+	candidate.done = true;
+	remaining--;
 }
 
 void Compiler::find_function_local_luts(SPIRFunction &entry, const AnalyzeVariableScopeAccessHandler &handler)
 {
 	auto &cfg = *function_cfgs.find(entry.self)->second;
 
+	// Variables which need a static expression, by the block which must write it.
+	// Each of these blocks is traversed once for all of its variables.
+	unordered_map<uint32_t, vector<uint32_t>> dominator_to_variables;
+
 	// For each variable which is statically accessed.
 	for (auto &accessed_var : handler.accessed_variables_to_block)
 	{
@@ -2808,6 +3536,7 @@ void Compiler::find_function_local_luts(SPIRFunction &entry, const AnalyzeVariab
 		else
 		{
 			// We can have one, and only one write to the variable, and that write needs to be a constant.
+			// The write is found below, once all candidates are known.
 
 			// No partial writes allowed.
 			if (handler.partial_write_variables_to_block.count(var.self) != 0)
@@ -2834,29 +3563,43 @@ void Compiler::find_function_local_luts(SPIRFunction &entry, const AnalyzeVariab
 			if (write_blocks.count(dominator) == 0)
 				continue;
 
-			// Find the static expression for this variable.
-			StaticExpressionAccessHandler static_expression_handler(*this, var.self);
-			traverse_all_reachable_opcodes(get<SPIRBlock>(dominator), static_expression_handler);
+			dominator_to_variables[dominator].push_back(var.self);
+			continue;
+		}
+
+		mark_function_local_lut(var, static_constant_expression);
+	}
 
+	for (auto &dominator : dominator_to_variables)
+	{
+		// Find the static expressions for these variables.
+		StaticExpressionAccessHandler static_expression_handler(*this, dominator.second);
+		traverse_all_reachable_opcodes(get<SPIRBlock>(dominator.first), static_expression_handler);
+
+		for (auto &candidate : static_expression_handler.candidates)
+		{
 			// We want one, and exactly one write
-			if (static_expression_handler.write_count != 1 || static_expression_handler.static_expression == 0)
+			if (candidate.second.write_count != 1 || candidate.second.static_expression == 0)
 				continue;
 
 			// Is it a constant expression?
-			if (ir.ids[static_expression_handler.static_expression].get_type() != TypeConstant)
+			if (ir.ids[candidate.second.static_expression].get_type() != TypeConstant)
 				continue;
 
 			// We found a LUT!
-			static_constant_expression = static_expression_handler.static_expression;
+			mark_function_local_lut(get<SPIRVariable>(candidate.first), candidate.second.static_expression);
 		}
-
-		get<SPIRConstant>(static_constant_expression).is_used_as_lut = true;
-		var.static_expression = static_constant_expression;
-		var.statically_assigned = true;
-		var.remapped_variable = true;
 	}
 }
 
+void Compiler::mark_function_local_lut(SPIRVariable &var, uint32_t static_constant_expression)
+{
+	get<SPIRConstant>(static_constant_expression).is_used_as_lut = true;
+	var.static_expression = static_constant_expression;
+	var.statically_assigned = true;
+	var.remapped_variable = true;
+}
+
 void Compiler::analyze_variable_scope(SPIRFunction &entry, AnalyzeVariableScopeAccessHandler &handler)
 {
 	// First, we map out all variable access within a function.
@@ -3076,7 +3819,10 @@ void Compiler::analyze_variable_scope(SPIRFunction &entry, AnalyzeVariableScopeA
 			continue;
 
 		// We have a loop variable.
-		header_block.loop_variables.push_back(loop_variable.first);
+		// The analysis runs again when a compiler is used to compile more than once, don't add it twice.
+		auto &loop_variables = header_block.loop_variables;
+		if (find(begin(loop_variables), end(loop_variables), loop_variable.first) == end(loop_variables))
+			loop_variables.push_back(loop_variable.first);
 		// Need to sort here as variables come from an unordered container, and pushing stuff in wrong order
 		// will break reproducability in regression runs.
 		sort(begin(header_block.loop_variables), end(header_block.loop_variables));
@@ -3264,6 +4010,7 @@ bool Compiler::ActiveBuiltinHandler::handle(spv::Op opcode, const uint32_t *args
 
 void Compiler::update_active_builtins()
 {
+	PhaseScope scope(*this, CompilerPhaseUpdateActiveBuiltins);
 	active_input_builtins.reset();
 	active_output_builtins.reset();
 	cull_distance_count = 0;
@@ -3293,6 +4040,7 @@ bool Compiler::has_active_builtin(BuiltIn builtin, StorageClass storage)
 
 void Compiler::analyze_image_and_sampler_usage()
 {
+	PhaseScope scope(*this, CompilerPhaseAnalyzeImageAndSamplerUsage);
 	CombinedImageSamplerDrefHandler dref_handler(*this);
 	traverse_all_reachable_opcodes(get<SPIRFunction>(ir.default_entry_point), dref_handler);
 
@@ -3334,17 +4082,29 @@ bool Compiler::CombinedImageSamplerDrefHandler::handle(spv::Op opcode, const uin
 
 void Compiler::build_function_control_flow_graphs_and_analyze()
 {
-	CFGBuilder handler(*this);
-	handler.function_cfgs[ir.default_entry_point].reset(new CFG(*this, get<SPIRFunction>(ir.default_entry_point)));
-	traverse_all_reachable_opcodes(get<SPIRFunction>(ir.default_entry_point), handler);
-	function_cfgs = move(handler.function_cfgs);
+	structural_queries.clear();
+
+	{
+		PhaseScope scope(*this, CompilerPhaseBuildCFG);
+		CFGBuilder handler(*this);
+		handler.function_cfgs[ir.default_entry_point].reset(
+		    new CFG(*this, get<SPIRFunction>(ir.default_entry_point)));
+		traverse_all_reachable_opcodes(get<SPIRFunction>(ir.default_entry_point), handler);
+		function_cfgs = move(handler.function_cfgs);
+	}
 
 	for (auto &f : function_cfgs)
 	{
 		auto &func = get<SPIRFunction>(f.first);
 		AnalyzeVariableScopeAccessHandler scope_handler(*this, func);
-		analyze_variable_scope(func, scope_handler);
-		find_function_local_luts(func, scope_handler);
+		{
+			PhaseScope scope(*this, CompilerPhaseAnalyzeVariableScope);
+			analyze_variable_scope(func, scope_handler);
+		}
+		{
+			PhaseScope scope(*this, CompilerPhaseFindFunctionLocalLUTs);
+			find_function_local_luts(func, scope_handler);
+		}
 
 		// Check if we can actually use the loop variables we found in analyze_variable_scope.
 		// To use multiple initializers, we need the same type and qualifiers.
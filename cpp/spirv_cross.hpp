@@ -19,10 +19,14 @@
 
 #include "spirv.hpp"
 #include "spirv_cfg.hpp"
+#include "spirv_cross_cache.hpp"
 #include "spirv_cross_parsed_ir.hpp"
+#include "spirv_cross_trace.hpp"
 
 namespace spirv_cross
 {
+class Parser;
+
 struct Resource
 {
 	// Resources are identified with their SPIR-V ID.
@@ -91,6 +95,14 @@ struct SpecializationConstant
 	uint32_t constant_id;
 };
 
+struct SpecializationConstantValue
+{
+	// The constant ID of the constant, used in Vulkan during pipeline creation.
+	uint32_t constant_id;
+	// Bit pattern of the value. 32-bit and boolean constants only use the lower 32 bits.
+	uint64_t value;
+};
+
 struct BufferRange
 {
 	unsigned index;
@@ -98,6 +110,44 @@ struct BufferRange
 	size_t range;
 };
 
+// A member of a buffer block as it is laid out in memory.
+// Nested structs are flattened, a struct member is followed by the members of that struct.
+// For arrays of structs, the members of the first element are listed.
+struct BufferLayoutMember
+{
+	// Member names from the block down, e.g. "lights[0].color".
+	std::string path;
+	uint32_t type_id;
+
+	// Offset in bytes from the start of the block.
+	uint32_t offset;
+
+	// Declared size in bytes, 0 for runtime arrays.
+	uint32_t size;
+
+	// Stride of the outermost array dimension, 0 if the member is not an array.
+	uint32_t array_stride;
+
+	// Stride between columns, or rows if row_major is set, 0 if the member is not a matrix.
+	uint32_t matrix_stride;
+	bool row_major;
+
+	SPIRType::BaseType basetype;
+	uint32_t vecsize;
+	uint32_t columns;
+
+	// Base alignment in bytes under std140 and std430.
+	uint32_t std140_alignment;
+	uint32_t std430_alignment;
+
+	// Whether the member is placed as std140 or std430 requires: its offset is a multiple of the alignment,
+	// its array stride is the standard one and a struct member follows the standard throughout.
+	// The packing columns are filled in by CompilerGLSL and the compilers derived from it, which know the packing
+	// rules. Compiler leaves them 0 and false.
+	bool std140_compliant;
+	bool std430_compliant;
+};
+
 enum BufferPackingStandard
 {
 	BufferPackingStd140,
@@ -114,6 +164,90 @@ struct EntryPoint
 	spv::ExecutionModel execution_model;
 };
 
+// Internal phases of the compiler which are timed in CompilerStats.
+enum CompilerPhase
+{
+	CompilerPhaseParse,
+	CompilerPhaseParseFixup,
+	CompilerPhaseBuildCFG,
+	CompilerPhaseAnalyzeVariableScope,
+	CompilerPhaseFindFunctionLocalLUTs,
+	CompilerPhaseUpdateActiveBuiltins,
+	CompilerPhaseAnalyzeImageAndSamplerUsage,
+	CompilerPhaseFindStaticExtensions,
+	CompilerPhaseEmitResources,
+	CompilerPhaseEmitFunction,
+	CompilerPhaseCount
+};
+
+// Returns a short name for a phase, e.g. "parse_fixup".
+const char *compiler_phase_name(CompilerPhase phase);
+
+// A backend gives up after this many passes of compile().
+static const uint32_t CompilerMaxPasses = 3;
+
+struct CompilerStats
+{
+	// Wall time in nanoseconds spent in each CompilerPhase, accumulated until reset_stats().
+	uint64_t phase_ns[CompilerPhaseCount];
+
+	// Wall time in nanoseconds of each pass of the last compile().
+	// A new pass is started whenever the backend has to force a recompile.
+	uint64_t pass_ns[CompilerMaxPasses];
+
+	// Number of opcodes visited by traversals of the control flow, accumulated until reset_stats().
+	uint64_t opcodes_visited;
+
+	// Number of statements written to the output, accumulated until reset_stats().
+	uint64_t statements_emitted;
+
+	// Size of the source returned by the last compile().
+	uint64_t bytes_output;
+
+	// Number of passes of the last compile().
+	uint32_t pass_count;
+
+	// Size of the module, in IDs and blocks.
+	uint32_t id_count;
+	uint32_t block_count;
+};
+
+// Number of values of Types, the kinds of IDs in the IR.
+static const uint32_t VariantTypeCount = TypeUndef + 1;
+
+// Approximate heap memory held by a compiler, in bytes.
+// It is derived from the capacity of the containers, allocator overhead is not included.
+struct CompilerMemoryFootprint
+{
+	// The module words, ParsedIR::spirv.
+	uint64_t spirv;
+
+	// IDs of each kind in Types, with everything they own. The ids array itself is counted under TypeNone.
+	uint64_t ids[VariantTypeCount];
+
+	// Decorations and names.
+	uint64_t meta;
+	uint64_t block_meta;
+
+	// Control flow graphs of the functions.
+	uint64_t cfgs;
+
+	// Names a backend reserves while emitting, to keep identifiers unique.
+	uint64_t name_caches;
+	uint64_t function_overloads;
+	uint64_t expression_usage_counts;
+
+	// Source written by the current or last pass of compile().
+	uint64_t output_buffer;
+
+	// Sum of everything above.
+	uint64_t total;
+
+	// Highest total at the end of a pass of compile() since reset_stats(), only tracked while stats are enabled.
+	// Expressions of a pass are freed when the next one starts, so this is usually higher than total.
+	uint64_t high_water_mark;
+};
+
 class Compiler
 {
 public:
@@ -264,6 +398,11 @@ public:
 	// Returns the effective size of a buffer block struct member.
 	virtual size_t get_declared_struct_member_size(const SPIRType &struct_type, uint32_t index) const;
 
+	// Returns every member of a buffer block with its offset, size, strides and type, see BufferLayoutMember.
+	// This is based on the declared Offset, ArrayStride and MatrixStride decorations.
+	// ID is the Resource::id obtained from get_shader_resources().
+	std::vector<BufferLayoutMember> get_declared_buffer_layout(uint32_t id) const;
+
 	// Legacy GLSL compatibility method. Deprecated in favor of CompilerGLSL::flatten_buffer_block
 	SPIRV_CROSS_DEPRECATED("Please use flatten_buffer_block instead.") void flatten_interface_block(uint32_t id);
 
@@ -307,6 +446,7 @@ public:
 	// Entry points should be set right after the constructor completes as some reflection functions traverse the graph from the entry point.
 	// Resource reflection also depends on the entry point.
 	// By default, the current entry point is set to the first OpEntryPoint which appears in the SPIR-V module.
+	// If the module was parsed lazily, setting an entry point parses the functions it calls which were skipped.
 	SPIRV_CROSS_DEPRECATED("Please use get_entry_points_and_stages instead.")
 	std::vector<std::string> get_entry_points() const;
 	SPIRV_CROSS_DEPRECATED("Please use set_entry_point(const std::string &, spv::ExecutionModel) instead.")
@@ -522,6 +662,44 @@ public:
 	// The most common use here is to check if a buffer is readonly or writeonly.
 	Bitset get_buffer_block_flags(uint32_t id) const;
 
+	// Enables timing of the internal phases of the compiler, and collection of various counters.
+	// This is off by default. Parsing happens in the constructor, so it is always timed.
+	void set_stats_enabled(bool enable)
+	{
+		stats_enabled = enable;
+	}
+
+	// Returns the statistics collected so far.
+	const CompilerStats &get_stats() const
+	{
+		return stats;
+	}
+
+	// Clears the accumulated timings and counters. The size of the module is kept.
+	void reset_stats();
+
+	// Walks all containers of the compiler, so it is not free on large modules.
+	CompilerMemoryFootprint get_memory_footprint() const;
+
+	// Attaches a recorder which receives an event for every timed phase, every traversal of a function,
+	// every pass of compile() and every emitted function. nullptr disables tracing, which is the default.
+	// The recorder is not owned by the compiler and must outlive it, or be detached first.
+	// Parsing happens in the constructor, so it never shows up in a trace.
+	void set_trace_recorder(TraceRecorder *recorder)
+	{
+		trace = recorder;
+	}
+
+	TraceRecorder *get_trace_recorder() const
+	{
+		return trace;
+	}
+
+	// Returns a key which identifies the output of compile() for the current state of the compiler:
+	// the SPIR-V module, the options, and all decorations, names, remaps and other changes made through this API.
+	// Returns an empty string if the output cannot be cached, i.e. when a variable type remap callback is set.
+	std::string get_compile_cache_key() const;
+
 protected:
 	const uint32_t *stream(const Instruction &instr) const
 	{
@@ -537,6 +715,74 @@ protected:
 	}
 
 	ParsedIR ir;
+
+	// Declared layouts only change when decorations, member names or constants do,
+	// so they are computed once per struct type. Keyed by SPIRType::self.
+	mutable std::unordered_map<uint32_t, size_t> declared_struct_size_cache;
+	mutable std::unordered_map<uint32_t, std::vector<BufferLayoutMember>> declared_buffer_layout_cache;
+	virtual void invalidate_declared_layouts();
+	void append_declared_struct_layout(const SPIRType &type, const std::string &prefix, uint32_t base_offset,
+	                                   std::vector<BufferLayoutMember> &layout) const;
+
+	// Fills in the packing columns of member index of type, see BufferLayoutMember.
+	virtual void set_declared_member_packing(const SPIRType &type, uint32_t index, BufferLayoutMember &member) const;
+
+	mutable CompilerStats stats = {};
+	bool stats_enabled = false;
+
+	// Backends add the state they own.
+	virtual void append_memory_footprint(CompilerMemoryFootprint &footprint) const;
+	void update_memory_high_water_mark();
+	uint64_t memory_high_water_mark = 0;
+
+	TraceRecorder *trace = nullptr;
+
+	// Adds the state compile() depends on to a cache key. Backends add their options and remaps.
+	// Without layout_values, the values of Binding, DescriptorSet and Location decorations are left out,
+	// but whether they are present is not.
+	virtual void append_compile_cache_key(CompileCacheKey &key, bool layout_values) const;
+	std::string build_compile_cache_key(bool layout_values, bool hashed) const;
+
+	// Adds the wall time spent in its scope to the given phase, if stats are enabled,
+	// and records it as a trace event if a recorder is attached.
+	class PhaseScope
+	{
+	public:
+		PhaseScope(const Compiler &compiler, CompilerPhase phase);
+		~PhaseScope();
+
+	private:
+		CompilerStats *stats;
+		TraceRecorder *trace;
+		CompilerPhase phase;
+		uint64_t start_ns = 0;
+	};
+
+	// Records the wall time spent in its scope as a trace event, if a recorder is attached.
+	// Arguments are only worth building when is_active() is true.
+	class TraceScope
+	{
+	public:
+		TraceScope(const Compiler &compiler, const char *category, const char *name);
+		~TraceScope();
+
+		bool is_active() const
+		{
+			return trace != nullptr;
+		}
+
+		void add_arg(const char *key, uint32_t value);
+		void add_arg(const char *key, const std::string &value);
+
+	private:
+		TraceRecorder *trace;
+		const char *category;
+		const char *name;
+		std::string args;
+		uint64_t start_ns = 0;
+	};
+	static uint64_t get_current_time_ns();
+
 	// Marks variables which have global scope and variables which can alias with other variables
 	// (SSBO, image load store, etc)
 	std::vector<uint32_t> global_variables;
@@ -638,17 +884,75 @@ protected:
 	}
 
 	// Dependency tracking for temporaries read from variables.
-	void flush_dependees(SPIRVariable &var);
+	// Every flush bumps a counter and stamps what it flushes with the new count, either a single variable or block,
+	// or a whole class of variables. Expressions remember the count at the time they took a dependency,
+	// so an expression is invalid once something it depends on carries a higher stamp.
+	// Flushing a class of variables costs the same however many variables and expressions it covers.
+	enum FlushClassBits
+	{
+		// Locals and arguments of the current function.
+		FlushClassFunctionBit = 1 << 0,
+		// Variables in global_variables.
+		FlushClassGlobalBit = 1 << 1,
+		// Variables in aliased_variables.
+		FlushClassAliasedBit = 1 << 2
+	};
+
+	struct FlushState
+	{
+		uint32_t count = 0;
+		uint32_t function_variables = 0;
+		uint32_t global_variables = 0;
+		uint32_t aliased_variables = 0;
+		// Variables and blocks flushed on their own, indexed by ID.
+		std::vector<uint32_t> ids;
+
+		void clear();
+		void flush_id(uint32_t id);
+	};
+	FlushState flushes;
+
+	// Variables which must not change while an expression is forwarded,
+	// or the block a control dependent expression was emitted in.
+	// The dependencies of all expressions share one list, each of them links to the one
+	// registered before it for the same expression.
+	struct FlushDependency
+	{
+		uint32_t id;
+		// The flush count when the dependency was taken. Anything flushed later has a higher count.
+		uint32_t flush_count;
+		uint32_t flush_classes;
+		uint32_t next;
+	};
+	std::vector<FlushDependency> flush_dependencies;
+
+	uint32_t get_flush_classes(const SPIRVariable &var);
+	void register_flush_dependency(SPIRExpression &expr, uint32_t id, uint32_t flush_classes);
+	void register_flush_dependency(SPIRExpression &expr, const SPIRVariable &var);
+	bool expression_is_invalidated(const SPIRExpression &expr) const;
+	void flush_variable(const SPIRVariable &var);
 	void flush_all_active_variables();
 	void flush_control_dependent_expressions(uint32_t block);
 	void flush_all_atomic_capable_variables();
 	void flush_all_aliased_variables();
-	void register_global_read_dependencies(const SPIRBlock &func, uint32_t id);
 	void register_global_read_dependencies(const SPIRFunction &func, uint32_t id);
-	std::unordered_set<uint32_t> invalid_expressions;
 
 	void update_name_cache(std::unordered_set<std::string> &cache, std::string &name);
 
+	// What a call to a function does, including everything the function calls.
+	// Summaries are built the first time a call is emitted and kept for the rest of the compile,
+	// so call sites do not rescan the callee and its callees on every call and every pass.
+	struct FunctionSummary
+	{
+		bool pure = true;
+
+		// Global variables which are loaded from.
+		std::unordered_set<uint32_t> global_reads;
+	};
+	std::unordered_map<uint32_t, FunctionSummary> function_summaries;
+	const FunctionSummary &get_function_summary(const SPIRFunction &func);
+	void add_global_reads(const SPIRBlock &block, FunctionSummary &summary);
+
 	bool function_is_pure(const SPIRFunction &func);
 	bool block_is_pure(const SPIRBlock &block);
 	bool block_is_outside_flow_control_from_block(const SPIRBlock &from, const SPIRBlock &to);
@@ -679,6 +983,17 @@ protected:
 	void set_ir(const ParsedIR &parsed);
 	void set_ir(ParsedIR &&parsed);
 	void parse_fixup();
+	void register_variable(const SPIRVariable &var);
+
+	// Parses the functions a lazy parse skipped which are reachable from entry,
+	// see Parser::set_lazy_function_parsing().
+	void parse_reachable_functions(uint32_t entry);
+
+	// Parses a new module in place of the current one, see CompilerGLSL::reset().
+	// Containers are cleared rather than replaced, so they keep their capacity.
+	void reset_module(std::vector<uint32_t> spirv);
+	void reset_module(const uint32_t *spirv, size_t word_count);
+	void reset_module(Parser &parser);
 
 	// Used internally to implement various traversals for queries.
 	struct OpcodeHandler
@@ -869,6 +1184,20 @@ protected:
 
 	void build_function_control_flow_graphs_and_analyze();
 	std::unordered_map<uint32_t, std::unique_ptr<CFG>> function_cfgs;
+
+	// Answers to structural queries about blocks, by pairs of block IDs. They only depend on the CFG,
+	// so they are kept until the CFGs are rebuilt, and emitting the same block chains again on every pass
+	// does not walk them again.
+	struct StructuralQueryCache
+	{
+		std::unordered_map<uint64_t, bool> outside_flow_control;
+
+		// By continue block and loop dominator, without complex_continue.
+		std::unordered_map<uint64_t, SPIRBlock::ContinueBlockType> continue_block_types;
+
+		void clear();
+	};
+	mutable StructuralQueryCache structural_queries;
 	struct CFGBuilder : OpcodeHandler
 	{
 		CFGBuilder(Compiler &compiler_);
@@ -901,20 +1230,33 @@ protected:
 		const SPIRBlock *current_block = nullptr;
 	};
 
+	// Finds the static expressions of all candidate variables written in a block, in one traversal of the block.
 	struct StaticExpressionAccessHandler : OpcodeHandler
 	{
-		StaticExpressionAccessHandler(Compiler &compiler_, uint32_t variable_id_);
+		StaticExpressionAccessHandler(Compiler &compiler_, const std::vector<uint32_t> &variable_ids);
 		bool follow_function_call(const SPIRFunction &) override;
 		bool handle(spv::Op op, const uint32_t *args, uint32_t length) override;
 
+		struct Candidate
+		{
+			uint32_t static_expression = 0;
+			uint32_t write_count = 0;
+
+			// Once an access rules out a static expression, the candidate is no longer tracked.
+			bool done = false;
+		};
+
 		Compiler &compiler;
-		uint32_t variable_id;
-		uint32_t static_expression = 0;
-		uint32_t write_count = 0;
+		std::unordered_map<uint32_t, Candidate> candidates;
+		uint32_t remaining;
+
+		Candidate *find_candidate(uint32_t id);
+		void finish(Candidate &candidate);
 	};
 
 	void analyze_variable_scope(SPIRFunction &function, AnalyzeVariableScopeAccessHandler &handler);
 	void find_function_local_luts(SPIRFunction &function, const AnalyzeVariableScopeAccessHandler &handler);
+	void mark_function_local_lut(SPIRVariable &var, uint32_t static_constant_expression);
 
 	void make_constant_null(uint32_t id, uint32_t type);
 
@@ -0,0 +1,457 @@
+/*
+ * Copyright 2016-2018 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "spirv_cross_cache.hpp"
+#include "spirv_common.hpp"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <direct.h>
+#include <windows.h>
+#endif
+
+using namespace std;
+
+namespace spirv_cross
+{
+static const uint32_t sha256_round_constants[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t rotate_right(uint32_t value, uint32_t count)
+{
+	return (value >> count) | (value << (32 - count));
+}
+
+CompileCacheKey::CompileCacheKey(bool hashed_)
+    : hashed(hashed_)
+{
+	static const uint32_t initial_state[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		                                       0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+	memcpy(state, initial_state, sizeof(state));
+}
+
+void CompileCacheKey::process_block(const uint8_t *data)
+{
+	uint32_t w[64];
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		w[i] = (uint32_t(data[4 * i]) << 24) | (uint32_t(data[4 * i + 1]) << 16) | (uint32_t(data[4 * i + 2]) << 8) |
+		       uint32_t(data[4 * i + 3]);
+	}
+
+	for (uint32_t i = 16; i < 64; i++)
+	{
+		uint32_t s0 = rotate_right(w[i - 15], 7) ^ rotate_right(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = rotate_right(w[i - 2], 17) ^ rotate_right(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+	for (uint32_t i = 0; i < 64; i++)
+	{
+		uint32_t s1 = rotate_right(e, 6) ^ rotate_right(e, 11) ^ rotate_right(e, 25);
+		uint32_t ch = (e & f) ^ (~e & g);
+		uint32_t t1 = h + s1 + ch + sha256_round_constants[i] + w[i];
+		uint32_t s0 = rotate_right(a, 2) ^ rotate_right(a, 13) ^ rotate_right(a, 22);
+		uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+		uint32_t t2 = s0 + maj;
+
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+	state[5] += f;
+	state[6] += g;
+	state[7] += h;
+}
+
+void CompileCacheKey::update(const uint8_t *data, size_t size)
+{
+	length += size;
+	if (!hashed)
+	{
+		encoding.append(reinterpret_cast<const char *>(data), size);
+		return;
+	}
+
+	if (block_size)
+	{
+		size_t count = min<size_t>(size, sizeof(block) - block_size);
+		memcpy(block + block_size, data, count);
+		block_size += uint32_t(count);
+		data += count;
+		size -= count;
+
+		if (block_size < sizeof(block))
+			return;
+
+		process_block(block);
+		block_size = 0;
+	}
+
+	while (size >= sizeof(block))
+	{
+		process_block(data);
+		data += sizeof(block);
+		size -= sizeof(block);
+	}
+
+	memcpy(block, data, size);
+	block_size = uint32_t(size);
+}
+
+void CompileCacheKey::u32(uint32_t value)
+{
+	uint8_t bytes[4] = { uint8_t(value), uint8_t(value >> 8), uint8_t(value >> 16), uint8_t(value >> 24) };
+	update(bytes, sizeof(bytes));
+}
+
+void CompileCacheKey::u64(uint64_t value)
+{
+	u32(uint32_t(value));
+	u32(uint32_t(value >> 32));
+}
+
+void CompileCacheKey::str(const string &value)
+{
+	u64(value.size());
+	update(reinterpret_cast<const uint8_t *>(value.data()), value.size());
+}
+
+void CompileCacheKey::words(const uint32_t *data, size_t count)
+{
+	u64(count);
+	for (size_t i = 0; i < count; i++)
+		u32(data[i]);
+}
+
+string CompileCacheKey::get() const
+{
+	if (!hashed)
+		return encoding;
+
+	// Finalize a copy, so more data can still be added afterwards.
+	CompileCacheKey final_key = *this;
+	uint64_t bit_length = length * 8;
+
+	uint8_t padding[72] = { 0x80 };
+	size_t padding_size = (block_size < 56 ? 56 : 120) - block_size;
+	for (uint32_t i = 0; i < 8; i++)
+		padding[padding_size + i] = uint8_t(bit_length >> (56 - 8 * i));
+	final_key.update(padding, padding_size + 8);
+
+	static const char hex_digits[] = "0123456789abcdef";
+	string key;
+	key.reserve(64);
+	for (auto word : final_key.state)
+		for (int shift = 28; shift >= 0; shift -= 4)
+			key += hex_digits[(word >> shift) & 0xf];
+	return key;
+}
+
+static bool is_valid_key(const string &key)
+{
+	if (key.empty())
+		return false;
+
+	for (char c : key)
+		if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+			return false;
+	return true;
+}
+
+static bool is_directory(const string &path)
+{
+	struct stat info;
+	return stat(path.c_str(), &info) == 0 && (info.st_mode & S_IFDIR) != 0;
+}
+
+static bool create_directory(const string &path)
+{
+#ifdef _WIN32
+	return _mkdir(path.c_str()) == 0;
+#else
+	return mkdir(path.c_str(), 0755) == 0;
+#endif
+}
+
+// Writes to a name no other writer uses, then renames into place.
+static bool write_file_atomic(const string &path, const string &data)
+{
+	static atomic<uint32_t> counter;
+	auto now = chrono::steady_clock::now().time_since_epoch().count();
+	auto thread_hash = hash<thread::id>()(this_thread::get_id());
+	auto temp_path = join(path, ".", uint64_t(now), ".", uint64_t(thread_hash), ".", counter++, ".tmp");
+
+	FILE *file = fopen(temp_path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+	written = fclose(file) == 0 && written;
+
+#ifdef _WIN32
+	// rename() does not replace existing files on Windows, MoveFileEx() does so in one step.
+	written = written && MoveFileExA(temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	written = written && rename(temp_path.c_str(), path.c_str()) == 0;
+#endif
+
+	if (!written)
+		::remove(temp_path.c_str());
+	return written;
+}
+
+static bool read_file(const string &path, string &data)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	data.clear();
+	char buffer[16 * 1024];
+	size_t count;
+	while ((count = fread(buffer, 1, sizeof(buffer), file)) != 0)
+		data.append(buffer, count);
+
+	bool success = ferror(file) == 0;
+	fclose(file);
+	return success;
+}
+
+CompileCache::CompileCache(string directory_, uint64_t max_size_)
+    : directory(move(directory_))
+    , max_size(max_size_)
+{
+	if (!is_directory(directory) && !create_directory(directory))
+		SPIRV_CROSS_THROW(join("Cannot create compile cache directory ", directory, "."));
+
+	read_index();
+}
+
+CompileCache::~CompileCache()
+{
+	lock_guard<mutex> holder(lock);
+	if (index_dirty)
+		write_index();
+}
+
+string CompileCache::get_entry_path(const string &key) const
+{
+	return join(directory, "/", key, ".glsl");
+}
+
+bool CompileCache::load(const string &key, string &source)
+{
+	if (!is_valid_key(key))
+		SPIRV_CROSS_THROW("Compile cache keys must be lowercase hex digits.");
+
+	lock_guard<mutex> holder(lock);
+
+	// Entries may have been added or evicted by other processes sharing the directory,
+	// so the file decides, not the index.
+	if (!read_file(get_entry_path(key), source))
+	{
+		misses++;
+		if (entries.count(key))
+		{
+			remove(key);
+			index_dirty = true;
+		}
+		return false;
+	}
+
+	hits++;
+	touch(key, source.size());
+	index_dirty = true;
+	return true;
+}
+
+void CompileCache::store(const string &key, const string &source)
+{
+	if (!is_valid_key(key))
+		SPIRV_CROSS_THROW("Compile cache keys must be lowercase hex digits.");
+
+	lock_guard<mutex> holder(lock);
+
+	// The cache is best effort, a failed write only means a later miss.
+	if (!write_file_atomic(get_entry_path(key), source))
+		return;
+
+	touch(key, source.size());
+	evict();
+	index_dirty = true;
+}
+
+void CompileCache::flush()
+{
+	lock_guard<mutex> holder(lock);
+	if (index_dirty)
+		write_index();
+}
+
+void CompileCache::clear()
+{
+	lock_guard<mutex> holder(lock);
+	for (auto &entry : lru)
+		::remove(get_entry_path(entry.key).c_str());
+
+	lru.clear();
+	entries.clear();
+	size = 0;
+	write_index();
+}
+
+uint64_t CompileCache::get_hit_count() const
+{
+	lock_guard<mutex> holder(lock);
+	return hits;
+}
+
+uint64_t CompileCache::get_miss_count() const
+{
+	lock_guard<mutex> holder(lock);
+	return misses;
+}
+
+void CompileCache::reset_counters()
+{
+	lock_guard<mutex> holder(lock);
+	hits = 0;
+	misses = 0;
+}
+
+uint64_t CompileCache::get_size() const
+{
+	lock_guard<mutex> holder(lock);
+	return size;
+}
+
+size_t CompileCache::get_entry_count() const
+{
+	lock_guard<mutex> holder(lock);
+	return entries.size();
+}
+
+void CompileCache::touch(const string &key, uint64_t entry_size)
+{
+	auto itr = entries.find(key);
+	if (itr != end(entries))
+	{
+		size -= itr->second->size;
+		lru.erase(itr->second);
+	}
+
+	lru.push_back({ key, entry_size });
+	entries[key] = prev(end(lru));
+	size += entry_size;
+}
+
+void CompileCache::remove(const string &key)
+{
+	auto itr = entries.find(key);
+	if (itr == end(entries))
+		return;
+
+	size -= itr->second->size;
+	lru.erase(itr->second);
+	entries.erase(itr);
+}
+
+void CompileCache::evict()
+{
+	while (size > max_size && !lru.empty())
+	{
+		auto key = lru.front().key;
+		::remove(get_entry_path(key).c_str());
+		remove(key);
+		index_dirty = true;
+	}
+}
+
+void CompileCache::read_index()
+{
+	string index;
+	if (!read_file(join(directory, "/index"), index))
+		return;
+
+	// The first line identifies the format, entries follow as "<key> <size>" lines, least recently used first.
+	auto header = join("spirv_cross_cache ", CompileCacheFormatVersion);
+	if (index.compare(0, header.size(), header) != 0)
+		return;
+
+	size_t pos = index.find('\n');
+	while (pos != string::npos && pos + 1 < index.size())
+	{
+		size_t start = pos + 1;
+		pos = index.find('\n', start);
+		auto line = index.substr(start, pos == string::npos ? string::npos : pos - start);
+
+		auto separator = line.find(' ');
+		if (separator == string::npos)
+			continue;
+
+		auto key = line.substr(0, separator);
+		if (is_valid_key(key))
+			touch(key, strtoull(line.c_str() + separator + 1, nullptr, 10));
+	}
+
+	evict();
+}
+
+void CompileCache::write_index()
+{
+	string index = join("spirv_cross_cache ", CompileCacheFormatVersion, "\n");
+	for (auto &entry : lru)
+		index += join(entry.key, " ", entry.size, "\n");
+
+	write_file_atomic(join(directory, "/index"), index);
+	index_dirty = false;
+}
+} // namespace spirv_cross
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2016-2018 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SPIRV_CROSS_CACHE_HPP
+#define SPIRV_CROSS_CACHE_HPP
+
+#include <list>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+namespace spirv_cross
+{
+// Bump when the generated code changes, so entries written by older versions are not reused.
+static const uint32_t CompileCacheFormatVersion = 1;
+
+// Builds a cache key from a canonical encoding of everything a compile depends on.
+// The key is the SHA-256 of the encoding. Strings are length prefixed and integers little endian,
+// so two different sequences of calls never produce the same encoding.
+// Keys which never leave the process can skip hashing. get() then returns the encoding itself,
+// which is faster to build and just as cheap to compare.
+class CompileCacheKey
+{
+public:
+	explicit CompileCacheKey(bool hashed = true);
+
+	void u32(uint32_t value);
+	void u64(uint64_t value);
+	void str(const std::string &value);
+	void words(const uint32_t *data, size_t count);
+
+	// Returns the hash of everything added so far as 64 lowercase hex digits, or the encoding if not hashed.
+	std::string get() const;
+
+private:
+	bool hashed;
+	std::string encoding;
+	uint32_t state[8];
+	uint64_t length = 0;
+	uint8_t block[64];
+	uint32_t block_size = 0;
+
+	void update(const uint8_t *data, size_t size);
+	void process_block(const uint8_t *data);
+};
+
+// Stores compiled sources in a local directory, one file per key.
+// Files are written to a temporary name and renamed into place, so concurrent readers,
+// including other processes sharing the directory, never see a partial entry.
+// Once the entries exceed the size limit, the least recently used ones are removed.
+// The recency order is kept in an index file in the same directory. It is written by flush() and on destruction,
+// so storing many entries does not rewrite it every time.
+// A cache may be shared by compilers running on different threads.
+class CompileCache
+{
+public:
+	// Creates directory if it does not exist yet.
+	CompileCache(std::string directory, uint64_t max_size);
+	~CompileCache();
+
+	// Returns true and fills in source if key is in the cache.
+	bool load(const std::string &key, std::string &source);
+	void store(const std::string &key, const std::string &source);
+
+	// Removes all entries.
+	void clear();
+
+	// Writes the index if entries were stored, loaded or evicted since it was last written.
+	void flush();
+
+	uint64_t get_hit_count() const;
+	uint64_t get_miss_count() const;
+	void reset_counters();
+
+	// Total size of the entries in bytes.
+	uint64_t get_size() const;
+	size_t get_entry_count() const;
+
+private:
+	struct Entry
+	{
+		std::string key;
+		uint64_t size;
+	};
+
+	mutable std::mutex lock;
+	std::string directory;
+	uint64_t max_size;
+	uint64_t size = 0;
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	bool index_dirty = false;
+
+	// Least recently used first.
+	std::list<Entry> lru;
+	std::unordered_map<std::string, std::list<Entry>::iterator> entries;
+
+	std::string get_entry_path(const std::string &key) const;
+	void touch(const std::string &key, uint64_t entry_size);
+	void remove(const std::string &key);
+	void evict();
+	void read_index();
+	void write_index();
+};
+} // namespace spirv_cross
+
+#endif
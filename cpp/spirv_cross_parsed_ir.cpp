@@ -29,6 +29,51 @@ void ParsedIR::set_id_bounds(uint32_t bounds)
 	block_meta.resize(bounds);
 }
 
+template <typename T>
+static ArrayView<T> get_block_span(const vector<T> &array, const BlockSpan &span)
+{
+	ArrayView<T> view;
+	if (!span.empty())
+	{
+		view.first = &array[span.offset];
+		view.last = view.first + span.count;
+	}
+	return view;
+}
+
+ArrayView<Instruction> ParsedIR::get_ops(const SPIRBlock &block) const
+{
+	return get_block_span(block_ops, block.ops);
+}
+
+ArrayView<SPIRBlock::Phi> ParsedIR::get_phis(const SPIRBlock &block) const
+{
+	return get_block_span(block_phis, block.phi_variables);
+}
+
+ArrayView<SPIRBlock::Case> ParsedIR::get_cases(const SPIRBlock &block) const
+{
+	return get_block_span(block_cases, block.cases);
+}
+
+void ParsedIR::reset()
+{
+	spirv.clear();
+	block_ops.clear();
+	block_phis.clear();
+	block_cases.clear();
+	ids.clear();
+	unparsed_functions.clear();
+	meta.clear();
+	declared_capabilities.clear();
+	declared_extensions.clear();
+	block_meta.clear();
+	continue_block_to_loop_header.clear();
+	entry_points.clear();
+	default_entry_point = 0;
+	source = Source();
+}
+
 static string ensure_valid_identifier(const string &name, bool member)
 {
 	// Functions in glslangValidator are mangled with name(<mangled> stuff.
@@ -36,12 +36,35 @@ public:
 	// Resizes ids, meta and block_meta.
 	void set_id_bounds(uint32_t bounds);
 
+	// Removes the module, but keeps the capacity of the containers for the next one.
+	void reset();
+
 	// The raw SPIR-V, instructions and opcodes refer to this by offset + count.
 	std::vector<uint32_t> spirv;
 
+	// Instructions, phi nodes and switch cases of all blocks, SPIRBlock refers to its own by BlockSpan.
+	// Blocks are contiguous in SPIR-V, and so are their elements here. A block needs no allocations of its own,
+	// and walking the blocks of a function walks these arrays in order.
+	std::vector<Instruction> block_ops;
+	std::vector<SPIRBlock::Phi> block_phis;
+	std::vector<SPIRBlock::Case> block_cases;
+
+	ArrayView<Instruction> get_ops(const SPIRBlock &block) const;
+	ArrayView<SPIRBlock::Phi> get_phis(const SPIRBlock &block) const;
+	ArrayView<SPIRBlock::Case> get_cases(const SPIRBlock &block) const;
+
 	// Holds various data structures which inherit from IVariant.
 	std::vector<Variant> ids;
 
+	// Functions a lazy parse skipped, by ID. Their instructions span count words of spirv from offset.
+	// Until Parser::parse_function() parses one, neither the function nor the IDs it declares are set.
+	struct FunctionRange
+	{
+		uint32_t offset;
+		uint32_t count;
+	};
+	std::unordered_map<uint32_t, FunctionRange> unparsed_functions;
+
 	// Various meta data for IDs, decorations, names, etc.
 	std::vector<Meta> meta;
 
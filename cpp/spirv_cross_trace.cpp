@@ -0,0 +1,169 @@
+/*
+ * Copyright 2016-2018 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "spirv_cross_trace.hpp"
+#include <chrono>
+#include <stdio.h>
+
+using namespace std;
+
+namespace spirv_cross
+{
+// Chrome traces are in microseconds. Print them with a fixed point
+// to keep nanosecond precision and to stay independent of the locale.
+static void append_microseconds(string &out, uint64_t ns)
+{
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%llu.%03u", static_cast<unsigned long long>(ns / 1000), unsigned(ns % 1000));
+	out += buf;
+}
+
+TraceRecorder::TraceRecorder()
+{
+	auto now = chrono::steady_clock::now().time_since_epoch();
+	origin_ns = uint64_t(chrono::duration_cast<chrono::nanoseconds>(now).count());
+}
+
+uint32_t TraceRecorder::get_thread_index(thread::id id)
+{
+	for (uint32_t i = 0; i < uint32_t(threads.size()); i++)
+		if (threads[i] == id)
+			return i;
+
+	threads.push_back(id);
+	return uint32_t(threads.size() - 1);
+}
+
+void TraceRecorder::add_event(const char *name, const char *category, uint64_t start_ns, uint64_t end_ns,
+                              string args)
+{
+	lock_guard<mutex> holder(lock);
+
+	// Events which started before the recorder existed are clamped to its creation.
+	if (start_ns < origin_ns)
+		start_ns = origin_ns;
+	if (end_ns < start_ns)
+		end_ns = start_ns;
+
+	Event event;
+	event.name = name;
+	event.category = category;
+	event.start_ns = start_ns - origin_ns;
+	event.duration_ns = end_ns - start_ns;
+	event.tid = get_thread_index(this_thread::get_id());
+	event.args = move(args);
+	events.push_back(move(event));
+}
+
+string TraceRecorder::get_json() const
+{
+	lock_guard<mutex> holder(lock);
+
+	string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	bool first = true;
+
+	for (uint32_t i = 0; i < uint32_t(threads.size()); i++)
+	{
+		if (!first)
+			json += ",";
+		first = false;
+
+		json += "\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":";
+		json += to_string(i);
+		json += ",\"args\":{\"name\":\"spirv_cross thread ";
+		json += to_string(i);
+		json += "\"}}";
+	}
+
+	for (auto &event : events)
+	{
+		if (!first)
+			json += ",";
+		first = false;
+
+		json += "\n{\"ph\":\"X\",\"name\":\"";
+		json += escape_json(event.name);
+		json += "\",\"cat\":\"";
+		json += escape_json(event.category);
+		json += "\",\"pid\":1,\"tid\":";
+		json += to_string(event.tid);
+		json += ",\"ts\":";
+		append_microseconds(json, event.start_ns);
+		json += ",\"dur\":";
+		append_microseconds(json, event.duration_ns);
+		if (!event.args.empty())
+		{
+			json += ",\"args\":{";
+			json += event.args;
+			json += "}";
+		}
+		json += "}";
+	}
+
+	json += "\n]}\n";
+	return json;
+}
+
+size_t TraceRecorder::get_event_count() const
+{
+	lock_guard<mutex> holder(lock);
+	return events.size();
+}
+
+void TraceRecorder::clear()
+{
+	lock_guard<mutex> holder(lock);
+	events.clear();
+	threads.clear();
+}
+
+string TraceRecorder::escape_json(const string &str)
+{
+	string escaped;
+	escaped.reserve(str.size());
+
+	for (char c : str)
+	{
+		switch (c)
+		{
+		case '"':
+			escaped += "\\\"";
+			break;
+		case '\\':
+			escaped += "\\\\";
+			break;
+		case '\n':
+			escaped += "\\n";
+			break;
+		case '\t':
+			escaped += "\\t";
+			break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20)
+			{
+				char buf[8];
+				snprintf(buf, sizeof(buf), "\\u%04x", unsigned(c));
+				escaped += buf;
+			}
+			else
+				escaped += c;
+			break;
+		}
+	}
+
+	return escaped;
+}
+} // namespace spirv_cross
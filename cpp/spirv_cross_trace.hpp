@@ -0,0 +1,74 @@
+/*
+ * Copyright 2016-2018 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SPIRV_CROSS_TRACE_HPP
+#define SPIRV_CROSS_TRACE_HPP
+
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace spirv_cross
+{
+// Collects timed events from one or more compilers and serializes them in the
+// Chrome trace event format, which can be loaded in chrome://tracing or https://ui.perfetto.dev.
+// A recorder may be shared by compilers running on different threads,
+// every thread gets its own track in the trace.
+class TraceRecorder
+{
+public:
+	TraceRecorder();
+
+	// Records a complete event on the track of the calling thread.
+	// Times are in nanoseconds, from the same steady clock the compiler uses.
+	// name and category must outlive the recorder, they are expected to be string literals.
+	// args is either empty or a list of JSON members without the enclosing braces, e.g. "\"id\":12".
+	void add_event(const char *name, const char *category, uint64_t start_ns, uint64_t end_ns,
+	               std::string args = std::string());
+
+	// Returns the recorded events as a Chrome trace JSON object.
+	std::string get_json() const;
+
+	size_t get_event_count() const;
+	void clear();
+
+	// Escapes a string for use in a JSON string literal.
+	static std::string escape_json(const std::string &str);
+
+private:
+	struct Event
+	{
+		const char *name;
+		const char *category;
+		uint64_t start_ns;
+		uint64_t duration_ns;
+		uint32_t tid;
+		std::string args;
+	};
+
+	mutable std::mutex lock;
+	uint64_t origin_ns;
+	std::vector<Event> events;
+	std::vector<std::thread::id> threads;
+
+	uint32_t get_thread_index(std::thread::id id);
+};
+} // namespace spirv_cross
+
+#endif
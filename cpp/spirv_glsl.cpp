@@ -276,7 +276,8 @@ void CompilerGLSL::reset()
 	force_recompile = false;
 
 	// Clear invalid expression tracking.
-	invalid_expressions.clear();
+	flushes.clear();
+	flush_dependencies.clear();
 	current_function = nullptr;
 
 	// Clear temporary usage tracking.
@@ -289,15 +290,11 @@ void CompilerGLSL::reset()
 	block_ubo_names.clear();
 	block_ssbo_names.clear();
 	function_overloads.clear();
+	layout_patch_slots.clear();
 
 	for (auto &id : ir.ids)
 	{
-		if (id.get_type() == TypeVariable)
-		{
-			// Clear unflushed dependees.
-			id.get<SPIRVariable>().dependees.clear();
-		}
-		else if (id.get_type() == TypeExpression)
+		if (id.get_type() == TypeExpression)
 		{
 			// And remove all expressions.
 			id.reset();
@@ -312,6 +309,7 @@ void CompilerGLSL::reset()
 
 	statement_count = 0;
 	indent = 0;
+	minify_last_char = '\n';
 }
 
 void CompilerGLSL::remap_pls_variables()
@@ -418,38 +416,129 @@ void CompilerGLSL::find_static_extensions()
 		require_extension_internal("GL_ARB_separate_shader_objects");
 }
 
+void CompilerGLSL::analyze_module_for_compile()
+{
+	build_function_control_flow_graphs_and_analyze();
+	fixup_image_load_store_access();
+	update_active_builtins();
+	analyze_image_and_sampler_usage();
+}
+
 string CompilerGLSL::compile()
 {
 	// Force a classic "C" locale, reverts when function returns
 	ClassicLocale classic_locale;
+	TraceScope compile_scope(*this, "compile", "compile");
+
+	if (layout_patching && !layout_patch_key.empty() && build_compile_cache_key(false, false) == layout_patch_key)
+	{
+		TraceScope patch_scope(*this, "compile", "patch_layout_values");
+		auto source = patch_layout_values();
+		if (stats_enabled)
+		{
+			fill(begin(stats.pass_ns), end(stats.pass_ns), 0);
+			stats.pass_count = 0;
+			stats.bytes_output = source.size();
+		}
+		return source;
+	}
+
+	string cache_key;
+	if (compile_cache)
+	{
+		string state_key = get_compile_cache_key();
+		cache_key = !state_key.empty() && state_key == compiled_state_key ? compiled_cache_key : state_key;
+		string source;
+		if (!cache_key.empty() && compile_cache->load(cache_key, source))
+		{
+			compiled_cache_key = cache_key;
+			compiled_state_key = state_key;
+
+			// Leave the compiler as a compile would have.
+			get_entry_point().name = "main";
+			if (stats_enabled)
+			{
+				fill(begin(stats.pass_ns), end(stats.pass_ns), 0);
+				stats.pass_count = 0;
+				stats.bytes_output = source.size();
+			}
+			return source;
+		}
+	}
 
 	if (options.vulkan_semantics)
 		backend.allow_precision_qualifiers = true;
 	backend.force_gl_in_out_block = true;
 	backend.supports_extensions = true;
 
+	if (!reuse_module_analysis)
+		analyze_module_for_compile();
+
 	// Scan the SPIR-V to find trivial uses of extensions.
-	build_function_control_flow_graphs_and_analyze();
-	find_static_extensions();
-	fixup_image_load_store_access();
-	update_active_builtins();
-	analyze_image_and_sampler_usage();
+	{
+		PhaseScope scope(*this, CompilerPhaseFindStaticExtensions);
+		find_static_extensions();
+	}
+
+	if (options.minify_identifiers)
+		build_minified_names();
+	else
+		minified_names.clear();
+
+	// Decorations might have changed since the last compile.
+	packed_struct_alignment_cache.clear();
+	packed_struct_size_cache.clear();
+	packing_standard_cache.clear();
+
+	// Summaries refer to the expressions of a compile, see get_function_summary().
+	function_summaries.clear();
+
+	if (stats_enabled)
+		fill(begin(stats.pass_ns), end(stats.pass_ns), 0);
+
+	// Legacy targets do not emit layout qualifiers, and they turn locations into gl_FragData indices.
+	recording_layout_patch = layout_patching && !is_legacy();
+	layout_patch_key.clear();
 
 	uint32_t pass_count = 0;
 	do
 	{
-		if (pass_count >= 3)
+		if (pass_count >= CompilerMaxPasses)
 			SPIRV_CROSS_THROW("Over 3 compilation loops detected. Must be a bug!");
 
+		uint64_t pass_start_ns = stats_enabled ? get_current_time_ns() : 0;
+		TraceScope pass_scope(*this, "compile", "compile_pass");
+		if (pass_scope.is_active())
+			pass_scope.add_arg("pass", pass_count);
+
 		reset();
 
 		// Move constructor for this type is broken on GCC 4.9 ...
-		buffer = unique_ptr<ostringstream>(new ostringstream());
+		// Once created, the stream is reused, so its storage is kept across passes and compiles.
+		if (buffer)
+		{
+			buffer->str("");
+			buffer->clear();
+		}
+		else
+			buffer = unique_ptr<ostringstream>(new ostringstream());
 
 		emit_header();
-		emit_resources();
+		{
+			PhaseScope scope(*this, CompilerPhaseEmitResources);
+			emit_resources();
+		}
 
-		emit_function(get<SPIRFunction>(ir.default_entry_point), Bitset());
+		{
+			PhaseScope scope(*this, CompilerPhaseEmitFunction);
+			emit_function(get<SPIRFunction>(ir.default_entry_point), Bitset());
+		}
+
+		if (stats_enabled)
+		{
+			stats.pass_ns[pass_count] = get_current_time_ns() - pass_start_ns;
+			update_memory_high_water_mark();
+		}
 
 		pass_count++;
 	} while (force_recompile);
@@ -457,7 +546,365 @@ string CompilerGLSL::compile()
 	// Entry point in GLSL is always main().
 	get_entry_point().name = "main";
 
-	return buffer->str();
+	auto source = buffer->str();
+	if (recording_layout_patch)
+	{
+		recording_layout_patch = false;
+		source = extract_layout_patch_slots(source);
+		layout_patch_key = build_compile_cache_key(false, false);
+	}
+
+	if (stats_enabled)
+	{
+		stats.pass_count = pass_count;
+		stats.bytes_output = source.size();
+	}
+
+	if (!cache_key.empty())
+	{
+		compile_cache->store(cache_key, source);
+		compiled_cache_key = cache_key;
+		compiled_state_key = get_compile_cache_key();
+	}
+	return source;
+}
+
+void CompilerGLSL::append_compile_cache_key(CompileCacheKey &key, bool layout_values) const
+{
+	Compiler::append_compile_cache_key(key, layout_values);
+
+	key.u32(options.version);
+	key.u32(options.es);
+	key.u32(options.force_temporary);
+	key.u32(options.vulkan_semantics);
+	key.u32(options.separate_shader_objects);
+	key.u32(options.flatten_multidimensional_arrays);
+	key.u32(options.enable_420pack_extension);
+	key.u32(options.minify);
+	key.u32(options.minify_identifiers);
+	key.u32(options.vertex.fixup_clipspace);
+	key.u32(options.vertex.flip_vert_y);
+	key.u32(options.vertex.support_nonzero_base_instance);
+	key.u32(options.fragment.default_float_precision);
+	key.u32(options.fragment.default_int_precision);
+
+	key.u32(uint32_t(header_lines.size()));
+	for (auto &line : header_lines)
+		key.str(line);
+	key.u32(uint32_t(forced_extensions.size()));
+	for (auto &ext : forced_extensions)
+		key.str(ext);
+
+	key.u32(uint32_t(pls_inputs.size()));
+	for (auto &pls : pls_inputs)
+	{
+		key.u32(pls.id);
+		key.u32(pls.format);
+	}
+	key.u32(uint32_t(pls_outputs.size()));
+	for (auto &pls : pls_outputs)
+	{
+		key.u32(pls.id);
+		key.u32(pls.format);
+	}
+
+	vector<uint32_t> flattened(begin(flattened_buffer_blocks), end(flattened_buffer_blocks));
+	sort(begin(flattened), end(flattened));
+	key.words(flattened.data(), flattened.size());
+}
+
+static uint64_t heap_size_with_strings(const unordered_set<string> &names)
+{
+	uint64_t size = heap_size(names);
+	for (auto &name : names)
+		size += heap_size(name);
+	return size;
+}
+
+void CompilerGLSL::append_memory_footprint(CompilerMemoryFootprint &footprint) const
+{
+	Compiler::append_memory_footprint(footprint);
+
+	footprint.name_caches = heap_size_with_strings(local_variable_names) + heap_size_with_strings(resource_names) +
+	                        heap_size_with_strings(block_input_names) + heap_size_with_strings(block_output_names) +
+	                        heap_size_with_strings(block_ubo_names) + heap_size_with_strings(block_ssbo_names) +
+	                        heap_size(minified_names);
+	for (auto &name : minified_names)
+		footprint.name_caches += heap_size(name.second);
+
+	footprint.function_overloads = heap_size(function_overloads);
+	for (auto &overloads : function_overloads)
+		footprint.function_overloads += heap_size(overloads.first) + heap_size(overloads.second);
+
+	footprint.expression_usage_counts = heap_size(expression_usage_counts);
+
+	if (buffer)
+	{
+		auto written = buffer->tellp();
+		if (written > 0)
+			footprint.output_buffer = uint64_t(written);
+	}
+}
+
+void CompilerGLSL::reset(vector<uint32_t> spirv)
+{
+	reset_compiler_state();
+	reset_module(move(spirv));
+	init();
+}
+
+void CompilerGLSL::reset(const uint32_t *spirv, size_t word_count)
+{
+	reset_compiler_state();
+	reset_module(spirv, word_count);
+	init();
+}
+
+void CompilerGLSL::reset_compiler_state()
+{
+	set_layout_patching_enabled(layout_patching);
+	reuse_module_analysis = false;
+	fold_specialization_constant_ops = false;
+	current_emitting_block = nullptr;
+	current_emitting_switch = nullptr;
+	if (buffer)
+	{
+		buffer->str("");
+		buffer->clear();
+	}
+	minify_last_char = '\n';
+	redirect_statement = nullptr;
+	current_continue_block = nullptr;
+	options = Options();
+	local_variable_names.clear();
+	resource_names.clear();
+	block_input_names.clear();
+	block_output_names.clear();
+	block_ubo_names.clear();
+	block_ssbo_names.clear();
+	function_overloads.clear();
+	processing_entry_point = false;
+	backend = BackendVariations();
+	packed_struct_alignment_cache.clear();
+	packed_struct_size_cache.clear();
+	packing_standard_cache.clear();
+	minified_names.clear();
+	replaced_fragment_output_aliases.clear();
+	indent = 0;
+	emitted_functions.clear();
+	flattened_buffer_blocks.clear();
+	flattened_structs.clear();
+	expression_usage_counts.clear();
+	forced_extensions.clear();
+	header_lines.clear();
+	statement_count = 0;
+	pls_inputs.clear();
+	pls_outputs.clear();
+}
+
+void CompilerGLSL::set_layout_patching_enabled(bool enable)
+{
+	layout_patching = enable;
+	layout_patch_key.clear();
+	layout_patch_source.clear();
+	layout_patch_source_slots.clear();
+}
+
+// While recording, a value is emitted as "\x01<slot>\x02<value>\x03".
+// None of the marker characters can appear in GLSL, and minification treats them like punctuation.
+string CompilerGLSL::layout_value(uint32_t id, uint32_t member, Decoration decoration, uint32_t value)
+{
+	if (!recording_layout_patch)
+		return convert_to_string(value);
+
+	layout_patch_slots.push_back({ id, member, decoration, 0, 0 });
+	return join('\x01', layout_patch_slots.size() - 1, '\x02', value, '\x03');
+}
+
+string CompilerGLSL::extract_layout_patch_slots(const string &source)
+{
+	string stripped;
+	stripped.reserve(source.size());
+	layout_patch_source_slots.clear();
+
+	size_t pos = 0;
+	for (;;)
+	{
+		auto begin_pos = source.find('\x01', pos);
+		if (begin_pos == string::npos)
+		{
+			stripped.append(source, pos, string::npos);
+			break;
+		}
+
+		auto value_pos = source.find('\x02', begin_pos);
+		auto end_pos = source.find('\x03', begin_pos);
+		if (value_pos == string::npos || end_pos == string::npos || end_pos < value_pos)
+			SPIRV_CROSS_THROW("Malformed layout value marker in output.");
+
+		auto index = uint32_t(stoul(source.substr(begin_pos + 1, value_pos - begin_pos - 1)));
+		if (index >= layout_patch_slots.size())
+			SPIRV_CROSS_THROW("Layout value marker refers to an unknown slot.");
+
+		stripped.append(source, pos, begin_pos - pos);
+		auto slot = layout_patch_slots[index];
+		slot.offset = stripped.size();
+		slot.length = end_pos - value_pos - 1;
+		stripped.append(source, value_pos + 1, slot.length);
+		layout_patch_source_slots.push_back(slot);
+		pos = end_pos + 1;
+	}
+
+	layout_patch_source = stripped;
+	return stripped;
+}
+
+string CompilerGLSL::patch_layout_values() const
+{
+	string source;
+	source.reserve(layout_patch_source.size() + layout_patch_source_slots.size() * 4);
+
+	size_t pos = 0;
+	for (auto &slot : layout_patch_source_slots)
+	{
+		source.append(layout_patch_source, pos, slot.offset - pos);
+		if (slot.member == ~0u)
+			source += convert_to_string(get_decoration(slot.id, slot.decoration));
+		else
+			source += convert_to_string(get_member_decoration(slot.id, slot.member, slot.decoration));
+		pos = slot.offset + slot.length;
+	}
+	source.append(layout_patch_source, pos, string::npos);
+	return source;
+}
+
+vector<string> CompilerGLSL::compile_specialization_variants(
+    const vector<vector<SpecializationConstantValue>> &variants)
+{
+	// Restores the default values and the regular compile() behavior, even if a variant fails to compile.
+	struct VariantScope
+	{
+		CompilerGLSL &compiler;
+		vector<pair<uint32_t, SPIRConstant::Constant>> defaults;
+
+		explicit VariantScope(CompilerGLSL &compiler_)
+		    : compiler(compiler_)
+		{
+		}
+
+		void restore_defaults()
+		{
+			for (auto &value : defaults)
+				compiler.get_constant(value.first).m.c[0].r[0] = value.second;
+		}
+
+		~VariantScope()
+		{
+			restore_defaults();
+			compiler.reuse_module_analysis = false;
+			compiler.fold_specialization_constant_ops = false;
+		}
+	};
+
+	VariantScope scope(*this);
+	unordered_map<uint32_t, uint32_t> constant_ids;
+	for (auto &spec : get_specialization_constants())
+	{
+		constant_ids[spec.constant_id] = spec.id;
+		scope.defaults.push_back({ spec.id, get<SPIRConstant>(spec.id).m.c[0].r[0] });
+	}
+
+	vector<string> sources;
+	sources.reserve(variants.size());
+	fold_specialization_constant_ops = true;
+
+	for (uint32_t i = 0; i < uint32_t(variants.size()); i++)
+	{
+		TraceScope variant_scope(*this, "compile", "compile_variant");
+		if (variant_scope.is_active())
+			variant_scope.add_arg("variant", i);
+
+		scope.restore_defaults();
+		for (auto &value : variants[i])
+		{
+			auto itr = constant_ids.find(value.constant_id);
+			if (itr == end(constant_ids))
+				SPIRV_CROSS_THROW(join("No specialization constant with constant_id ", value.constant_id, "."));
+
+			auto &c = get_constant(itr->second);
+			auto &type = get<SPIRType>(c.constant_type);
+			if (type.basetype == SPIRType::Boolean)
+				c.m.c[0].r[0].u32 = value.value != 0;
+			else if (type.width == 64)
+				c.m.c[0].r[0].u64 = value.value;
+			else
+				c.m.c[0].r[0].u32 = uint32_t(value.value);
+		}
+
+		sources.push_back(compile());
+
+		// Only the constant values change from here on, the control flow and usage analysis still holds.
+		reuse_module_analysis = true;
+	}
+
+	return sources;
+}
+
+vector<string> CompilerGLSL::compile_all(const vector<Options> &profiles)
+{
+	// compile() sets backend flags and adds the extensions it finds, which must not leak into the next profile.
+	struct ProfileScope
+	{
+		CompilerGLSL &compiler;
+		Options options;
+		BackendVariations backend;
+		vector<string> forced_extensions;
+
+		explicit ProfileScope(CompilerGLSL &compiler_)
+		    : compiler(compiler_)
+		    , options(compiler_.options)
+		    , backend(compiler_.backend)
+		    , forced_extensions(compiler_.forced_extensions)
+		{
+		}
+
+		void restore_state()
+		{
+			compiler.backend = backend;
+			compiler.forced_extensions = forced_extensions;
+			compiler.restore_fragment_outputs();
+		}
+
+		~ProfileScope()
+		{
+			restore_state();
+			compiler.options = options;
+			compiler.reuse_module_analysis = false;
+		}
+	};
+
+	ProfileScope scope(*this);
+	vector<string> sources;
+	sources.reserve(profiles.size());
+
+	for (uint32_t i = 0; i < uint32_t(profiles.size()); i++)
+	{
+		TraceScope profile_scope(*this, "compile", "compile_profile");
+		if (profile_scope.is_active())
+		{
+			profile_scope.add_arg("version", profiles[i].version);
+			profile_scope.add_arg("es", profiles[i].es ? 1u : 0u);
+		}
+
+		scope.restore_state();
+		options = profiles[i];
+		sources.push_back(compile());
+
+		// The CFGs, variable scopes, active builtins and image usage do not depend on the options.
+		reuse_module_analysis = true;
+	}
+
+	return sources;
 }
 
 std::string CompilerGLSL::get_partial_source()
@@ -807,7 +1254,7 @@ string CompilerGLSL::layout_for_member(const SPIRType &type, uint32_t index)
 	//    attr.push_back("column_major");
 
 	if (dec.decoration_flags.get(DecorationLocation) && can_use_io_location(type.storage, true))
-		attr.push_back(join("location = ", dec.location));
+		attr.push_back(join("location = ", layout_value(type.self, index, DecorationLocation, dec.location)));
 
 	// Can only declare component if we can declare location.
 	if (dec.decoration_flags.get(DecorationComponent) && can_use_io_location(type.storage, true))
@@ -929,7 +1376,7 @@ const char *CompilerGLSL::format_to_glsl(spv::ImageFormat format)
 	}
 }
 
-uint32_t CompilerGLSL::type_to_packed_base_size(const SPIRType &type, BufferPackingStandard)
+uint32_t CompilerGLSL::type_to_packed_base_size(const SPIRType &type, BufferPackingStandard) const
 {
 	switch (type.basetype)
 	{
@@ -955,7 +1402,7 @@ uint32_t CompilerGLSL::type_to_packed_base_size(const SPIRType &type, BufferPack
 }
 
 uint32_t CompilerGLSL::type_to_packed_alignment(const SPIRType &type, const Bitset &flags,
-                                                BufferPackingStandard packing)
+                                                BufferPackingStandard packing) const
 {
 	if (!type.array.empty())
 	{
@@ -973,6 +1420,11 @@ uint32_t CompilerGLSL::type_to_packed_alignment(const SPIRType &type, const Bits
 
 	if (type.basetype == SPIRType::Struct)
 	{
+		auto key = get_packing_cache_key(type, packing);
+		auto itr = packed_struct_alignment_cache.find(key);
+		if (itr != end(packed_struct_alignment_cache))
+			return itr->second;
+
 		// Rule 9. Structs alignments are maximum alignment of its members.
 		uint32_t alignment = 0;
 		for (uint32_t i = 0; i < type.member_types.size(); i++)
@@ -986,6 +1438,7 @@ uint32_t CompilerGLSL::type_to_packed_alignment(const SPIRType &type, const Bits
 		if (packing_is_vec4_padded(packing))
 			alignment = max(alignment, 16u);
 
+		packed_struct_alignment_cache[key] = alignment;
 		return alignment;
 	}
 	else
@@ -1044,7 +1497,7 @@ uint32_t CompilerGLSL::type_to_packed_alignment(const SPIRType &type, const Bits
 }
 
 uint32_t CompilerGLSL::type_to_packed_array_stride(const SPIRType &type, const Bitset &flags,
-                                                   BufferPackingStandard packing)
+                                                   BufferPackingStandard packing) const
 {
 	// Array stride is equal to aligned size of the underlying type.
 	uint32_t parent = type.parent_type;
@@ -1066,7 +1519,8 @@ uint32_t CompilerGLSL::type_to_packed_array_stride(const SPIRType &type, const B
 	}
 }
 
-uint32_t CompilerGLSL::type_to_packed_size(const SPIRType &type, const Bitset &flags, BufferPackingStandard packing)
+uint32_t CompilerGLSL::type_to_packed_size(const SPIRType &type, const Bitset &flags,
+                                           BufferPackingStandard packing) const
 {
 	if (!type.array.empty())
 	{
@@ -1077,6 +1531,11 @@ uint32_t CompilerGLSL::type_to_packed_size(const SPIRType &type, const Bitset &f
 
 	if (type.basetype == SPIRType::Struct)
 	{
+		auto key = get_packing_cache_key(type, packing);
+		auto itr = packed_struct_size_cache.find(key);
+		if (itr != end(packed_struct_size_cache))
+			return itr->second;
+
 		uint32_t pad_alignment = 1;
 
 		for (uint32_t i = 0; i < type.member_types.size(); i++)
@@ -1097,6 +1556,8 @@ uint32_t CompilerGLSL::type_to_packed_size(const SPIRType &type, const Bitset &f
 			size = (size + alignment - 1) & ~(alignment - 1);
 			size += type_to_packed_size(member_type, member_flags, packing);
 		}
+
+		packed_struct_size_cache[key] = size;
 	}
 	else
 	{
@@ -1130,7 +1591,7 @@ uint32_t CompilerGLSL::type_to_packed_size(const SPIRType &type, const Bitset &f
 }
 
 bool CompilerGLSL::buffer_is_packing_standard(const SPIRType &type, BufferPackingStandard packing,
-                                              uint32_t start_offset, uint32_t end_offset)
+                                              uint32_t start_offset, uint32_t end_offset) const
 {
 	// This is very tricky and error prone, but try to be exhaustive and correct here.
 	// SPIR-V doesn't directly say if we're using std430 or std140.
@@ -1145,6 +1606,25 @@ bool CompilerGLSL::buffer_is_packing_standard(const SPIRType &type, BufferPackin
 	// in arrays and structs. In std140 they take minimum vec4 alignment.
 	// std430 only removes the vec4 requirement.
 
+	// Only the result for the whole struct is worth remembering.
+	bool whole_struct = start_offset == 0 && end_offset == ~(0u);
+	uint64_t key = get_packing_cache_key(type, packing);
+	if (whole_struct)
+	{
+		auto itr = packing_standard_cache.find(key);
+		if (itr != end(packing_standard_cache))
+			return itr->second;
+	}
+
+	bool result = buffer_is_packing_standard_uncached(type, packing, start_offset, end_offset);
+	if (whole_struct)
+		packing_standard_cache[key] = result;
+	return result;
+}
+
+bool CompilerGLSL::buffer_is_packing_standard_uncached(const SPIRType &type, BufferPackingStandard packing,
+                                                       uint32_t start_offset, uint32_t end_offset) const
+{
 	uint32_t offset = 0;
 	uint32_t pad_alignment = 1;
 
@@ -1233,6 +1713,48 @@ bool CompilerGLSL::buffer_is_packing_standard(const SPIRType &type, BufferPackin
 	return true;
 }
 
+bool CompilerGLSL::member_is_packing_standard(const SPIRType &type, uint32_t index, uint32_t offset,
+                                              BufferPackingStandard packing) const
+{
+	auto &memb_type = get<SPIRType>(type.member_types[index]);
+	auto &member_flags = get_member_decoration_bitset(type.self, index);
+
+	if (offset % type_to_packed_alignment(memb_type, member_flags, packing) != 0)
+		return false;
+	if (!memb_type.array.empty() &&
+	    type_to_packed_array_stride(memb_type, member_flags, packing) != type_struct_member_array_stride(type, index))
+		return false;
+	if (!memb_type.member_types.empty() && !buffer_is_packing_standard(memb_type, packing))
+		return false;
+	return true;
+}
+
+void CompilerGLSL::set_declared_member_packing(const SPIRType &type, uint32_t index, BufferLayoutMember &member) const
+{
+	auto &memb_type = get<SPIRType>(type.member_types[index]);
+	auto &member_flags = get_member_decoration_bitset(type.self, index);
+
+	member.std140_alignment = type_to_packed_alignment(memb_type, member_flags, BufferPackingStd140);
+	member.std430_alignment = type_to_packed_alignment(memb_type, member_flags, BufferPackingStd430);
+	member.std140_compliant = member_is_packing_standard(type, index, member.offset, BufferPackingStd140);
+	member.std430_compliant = member_is_packing_standard(type, index, member.offset, BufferPackingStd430);
+}
+
+void CompilerGLSL::invalidate_declared_layouts()
+{
+	Compiler::invalidate_declared_layouts();
+
+	// The packing of a struct depends on its decorations as well.
+	packed_struct_alignment_cache.clear();
+	packed_struct_size_cache.clear();
+	packing_standard_cache.clear();
+}
+
+uint64_t CompilerGLSL::get_packing_cache_key(const SPIRType &type, BufferPackingStandard packing)
+{
+	return (uint64_t(type.self) << 32) | uint32_t(packing);
+}
+
 bool CompilerGLSL::can_use_io_location(StorageClass storage, bool block)
 {
 	// Location specifiers are must have in SPIR-V, but they aren't really supported in earlier versions of GLSL.
@@ -1309,7 +1831,7 @@ string CompilerGLSL::layout_for_variable(const SPIRVariable &var)
 		// If our members have location decorations, we don't need to
 		// emit location decorations at the top as well (looks weird).
 		if (!combined_decoration.get(DecorationLocation))
-			attr.push_back(join("location = ", dec.location));
+			attr.push_back(join("location = ", layout_value(var.self, ~0u, DecorationLocation, dec.location)));
 	}
 
 	// Can only declare Component if we can declare location.
@@ -1335,7 +1857,7 @@ string CompilerGLSL::layout_for_variable(const SPIRVariable &var)
 	if (var.storage != StorageClassPushConstant)
 	{
 		if (flags.get(DecorationDescriptorSet) && options.vulkan_semantics)
-			attr.push_back(join("set = ", dec.set));
+			attr.push_back(join("set = ", layout_value(var.self, ~0u, DecorationDescriptorSet, dec.set)));
 	}
 
 	// GL 3.0/GLSL 1.30 is not considered legacy, but it doesn't have UBOs ...
@@ -1352,7 +1874,7 @@ string CompilerGLSL::layout_for_variable(const SPIRVariable &var)
 		can_use_binding = false;
 
 	if (can_use_binding && flags.get(DecorationBinding))
-		attr.push_back(join("binding = ", dec.binding));
+		attr.push_back(join("binding = ", layout_value(var.self, ~0u, DecorationBinding, dec.binding)));
 
 	if (flags.get(DecorationOffset))
 		attr.push_back(join("offset = ", dec.offset));
@@ -1778,7 +2300,208 @@ void CompilerGLSL::emit_specialization_constant_op(const SPIRConstantOp &constan
 {
 	auto &type = get<SPIRType>(constant.basetype);
 	auto name = to_name(constant.self);
-	statement("const ", variable_decl(type, name), " = ", constant_op_expression(constant), ";");
+
+	uint32_t value;
+	if (fold_specialization_constant_ops && fold_constant_op(constant, value))
+	{
+		SPIRConstant folded(constant.basetype, value, false);
+		statement("const ", variable_decl(type, name), " = ", constant_expression(folded), ";");
+	}
+	else
+		statement("const ", variable_decl(type, name), " = ", constant_op_expression(constant), ";");
+}
+
+bool CompilerGLSL::get_foldable_scalar(uint32_t id, uint32_t &value) const
+{
+	switch (ir.ids[id].get_type())
+	{
+	case TypeConstant:
+	{
+		auto &c = get<SPIRConstant>(id);
+		auto &type = get<SPIRType>(c.constant_type);
+		bool scalar_type = type.vecsize == 1 && type.columns == 1 && type.array.empty();
+		bool integer_type = type.basetype == SPIRType::Boolean ||
+		                    ((type.basetype == SPIRType::Int || type.basetype == SPIRType::UInt) && type.width == 32);
+		if (!scalar_type || !integer_type)
+			return false;
+
+		value = c.scalar();
+		return true;
+	}
+
+	case TypeConstantOp:
+		return fold_constant_op(get<SPIRConstantOp>(id), value);
+
+	default:
+		return false;
+	}
+}
+
+bool CompilerGLSL::fold_constant_op(const SPIRConstantOp &cop, uint32_t &value) const
+{
+	auto &type = get<SPIRType>(cop.basetype);
+	bool scalar_type = type.vecsize == 1 && type.columns == 1 && type.array.empty();
+	bool integer_type = type.basetype == SPIRType::Boolean ||
+	                    ((type.basetype == SPIRType::Int || type.basetype == SPIRType::UInt) && type.width == 32);
+	if (!scalar_type || !integer_type)
+		return false;
+
+	uint32_t args[3] = {};
+	uint32_t num_args = uint32_t(cop.arguments.size());
+	if (num_args < 1 || num_args > 3)
+		return false;
+	for (uint32_t i = 0; i < num_args; i++)
+		if (!get_foldable_scalar(cop.arguments[i], args[i]))
+			return false;
+
+	bool unary = num_args == 1;
+	bool binary = num_args == 2;
+	uint32_t a = args[0];
+	uint32_t b = args[1];
+	int32_t sa = int32_t(a);
+	int32_t sb = int32_t(b);
+
+	switch (cop.opcode)
+	{
+	case OpSNegate:
+		if (!unary)
+			return false;
+		value = 0u - a;
+		return true;
+
+	case OpNot:
+		if (!unary)
+			return false;
+		value = ~a;
+		return true;
+
+	case OpLogicalNot:
+		if (!unary)
+			return false;
+		value = a == 0;
+		return true;
+
+	case OpSelect:
+		if (num_args != 3)
+			return false;
+		value = a != 0 ? b : args[2];
+		return true;
+
+	default:
+		break;
+	}
+
+	if (!binary)
+		return false;
+
+	switch (cop.opcode)
+	{
+	case OpIAdd:
+		value = a + b;
+		break;
+	case OpISub:
+		value = a - b;
+		break;
+	case OpIMul:
+		value = a * b;
+		break;
+	case OpUDiv:
+		if (b == 0)
+			return false;
+		value = a / b;
+		break;
+	case OpUMod:
+		if (b == 0)
+			return false;
+		value = a % b;
+		break;
+	case OpSDiv:
+		if (sb == 0 || (sa == numeric_limits<int32_t>::min() && sb == -1))
+			return false;
+		value = uint32_t(sa / sb);
+		break;
+	case OpSMod:
+	{
+		if (sb == 0 || (sa == numeric_limits<int32_t>::min() && sb == -1))
+			return false;
+		// The result of SMod takes the sign of the divisor.
+		int32_t rem = sa % sb;
+		if (rem != 0 && ((rem < 0) != (sb < 0)))
+			rem += sb;
+		value = uint32_t(rem);
+		break;
+	}
+	case OpShiftLeftLogical:
+		if (b >= 32)
+			return false;
+		value = a << b;
+		break;
+	case OpShiftRightLogical:
+		if (b >= 32)
+			return false;
+		value = a >> b;
+		break;
+	case OpShiftRightArithmetic:
+		if (b >= 32)
+			return false;
+		value = sa < 0 ? ~(~a >> b) : a >> b;
+		break;
+	case OpBitwiseOr:
+		value = a | b;
+		break;
+	case OpBitwiseXor:
+		value = a ^ b;
+		break;
+	case OpBitwiseAnd:
+		value = a & b;
+		break;
+	case OpLogicalOr:
+		value = a != 0 || b != 0;
+		break;
+	case OpLogicalAnd:
+		value = a != 0 && b != 0;
+		break;
+	case OpLogicalEqual:
+		value = (a != 0) == (b != 0);
+		break;
+	case OpLogicalNotEqual:
+		value = (a != 0) != (b != 0);
+		break;
+	case OpIEqual:
+		value = a == b;
+		break;
+	case OpINotEqual:
+		value = a != b;
+		break;
+	case OpULessThan:
+		value = a < b;
+		break;
+	case OpSLessThan:
+		value = sa < sb;
+		break;
+	case OpULessThanEqual:
+		value = a <= b;
+		break;
+	case OpSLessThanEqual:
+		value = sa <= sb;
+		break;
+	case OpUGreaterThan:
+		value = a > b;
+		break;
+	case OpSGreaterThan:
+		value = sa > sb;
+		break;
+	case OpUGreaterThanEqual:
+		value = a >= b;
+		break;
+	case OpSGreaterThanEqual:
+		value = sa >= sb;
+		break;
+	default:
+		return false;
+	}
+
+	return true;
 }
 
 void CompilerGLSL::emit_constant(const SPIRConstant &constant)
@@ -1916,6 +2639,9 @@ void CompilerGLSL::replace_fragment_output(SPIRVariable &var)
 	if (m.decoration_flags.get(DecorationLocation))
 		location = m.location;
 
+	if (!var.compat_builtin)
+		replaced_fragment_output_aliases[var.self] = m.alias;
+
 	// If our variable is arrayed, we must not emit the array part of this as the SPIR-V will
 	// do the access chain part of this for us.
 	auto &type = get<SPIRType>(var.basetype);
@@ -1963,6 +2689,16 @@ void CompilerGLSL::replace_fragment_outputs()
 	}
 }
 
+void CompilerGLSL::restore_fragment_outputs()
+{
+	for (auto &output : replaced_fragment_output_aliases)
+	{
+		ir.meta[output.first].decoration.alias = output.second;
+		get<SPIRVariable>(output.first).compat_builtin = false;
+	}
+	replaced_fragment_output_aliases.clear();
+}
+
 string CompilerGLSL::remap_swizzle(const SPIRType &out_type, uint32_t input_components, const string &expr)
 {
 	if (out_type.vecsize == input_components)
@@ -2552,27 +3288,29 @@ string CompilerGLSL::to_extract_component_expression(uint32_t id, uint32_t index
 
 string CompilerGLSL::to_expression(uint32_t id)
 {
-	auto itr = invalid_expressions.find(id);
-	if (itr != end(invalid_expressions))
-		handle_invalid_expression(id);
-
 	if (ir.ids[id].get_type() == TypeExpression)
 	{
+		auto &expr = get<SPIRExpression>(id);
+		if (expression_is_invalidated(expr))
+			handle_invalid_expression(id);
+
 		// We might have a more complex chain of dependencies.
 		// A possible scenario is that we
 		//
 		// %1 = OpLoad
 		// %2 = OpDoSomething %1 %1. here %2 will have a dependency on %1.
 		// %3 = OpDoSomethingAgain %2 %2. Here %3 will lose the link to %1 since we don't propagate the dependencies like that.
-		// OpStore %1 %foo // Here we can invalidate %1, and hence all expressions which depend on %1. Only %2 will know since it's part of invalid_expressions.
+		// OpStore %1 %foo // Here we can invalidate %1, and hence all expressions which depend on %1. Only %2 will know since it depends on the variable.
 		// %4 = OpDoSomethingAnotherTime %3 %3 // If we forward all expressions we will see %1 expression after store, not before.
 		//
 		// However, we can propagate up a list of depended expressions when we used %2, so we can check if %2 is invalid when reading %3 after the store,
 		// and see that we should not forward reads of the original variable.
-		auto &expr = get<SPIRExpression>(id);
 		for (uint32_t dep : expr.expression_dependencies)
-			if (invalid_expressions.find(dep) != end(invalid_expressions))
+		{
+			auto *dep_expr = maybe_get<SPIRExpression>(dep);
+			if (dep_expr && expression_is_invalidated(*dep_expr))
 				handle_invalid_expression(dep);
+		}
 	}
 
 	track_expression_read(id);
@@ -6142,10 +6880,7 @@ bool CompilerGLSL::args_will_forward(uint32_t id, const uint32_t *args, uint32_t
 void CompilerGLSL::register_impure_function_call()
 {
 	// Impure functions can modify globals and aliased variables, so invalidate them as well.
-	for (auto global : global_variables)
-		flush_dependees(get<SPIRVariable>(global));
-	for (auto aliased : aliased_variables)
-		flush_dependees(get<SPIRVariable>(aliased));
+	flush_all_atomic_capable_variables();
 }
 
 void CompilerGLSL::register_call_out_argument(uint32_t id)
@@ -6416,14 +7151,17 @@ void CompilerGLSL::register_control_dependent_expression(uint32_t expr)
 	if (forwarded_temporaries.find(expr) == end(forwarded_temporaries))
 		return;
 
+	// Some expressions are control-flow dependent, i.e. any instruction which relies on derivatives or
+	// sub-group-like operations.
+	// Make sure that we only use these expressions in the original block.
 	assert(current_emitting_block);
-	current_emitting_block->invalidate_expressions.push_back(expr);
+	register_flush_dependency(get<SPIRExpression>(expr), current_emitting_block->self, 0);
 }
 
 void CompilerGLSL::emit_block_instructions(SPIRBlock &block)
 {
 	current_emitting_block = &block;
-	for (auto &op : block.ops)
+	for (auto &op : ir.get_ops(block))
 		emit_instruction(op);
 	current_emitting_block = nullptr;
 }
@@ -8012,7 +8750,7 @@ void CompilerGLSL::emit_instruction(const Instruction &instruction)
 			{
 				e.loaded_from = var->self;
 				if (forward)
-					var->dependees.push_back(id);
+					register_flush_dependency(e, *var);
 			}
 		}
 		else
@@ -9198,6 +9936,128 @@ void CompilerGLSL::add_resource_name(uint32_t id)
 	add_variable(resource_names, id);
 }
 
+string CompilerGLSL::to_name(uint32_t id, bool allow_alias) const
+{
+	if (!minified_names.empty())
+	{
+		auto itr = minified_names.find(id);
+		if (itr != end(minified_names))
+			return itr->second;
+	}
+
+	return Compiler::to_name(id, allow_alias);
+}
+
+void CompilerGLSL::build_minified_names()
+{
+	minified_names.clear();
+
+	// Collect the IDs which never show up in the interface of the shader.
+	vector<uint32_t> candidates;
+	auto add_candidate = [&](uint32_t id) {
+		if (!ir.meta[id].decoration.decoration_flags.get(DecorationBuiltIn))
+			candidates.push_back(id);
+	};
+
+	for (uint32_t id = 0; id < uint32_t(ir.ids.size()); id++)
+	{
+		switch (ir.ids[id].get_type())
+		{
+		case TypeVariable:
+		{
+			auto &var = get<SPIRVariable>(id);
+			if (var.remapped_variable)
+				break;
+			// Function local variables and parameters are collected with their function below.
+			if (var.storage == StorageClassPrivate || var.storage == StorageClassWorkgroup)
+				add_candidate(id);
+			break;
+		}
+
+		case TypeConstant:
+		{
+			// Only composite constants are declared with a name, the rest are inlined as literals.
+			auto &c = get<SPIRConstant>(id);
+			auto &type = get<SPIRType>(c.constant_type);
+			if (!c.specialization && (!type.array.empty() || type.basetype == SPIRType::Struct))
+				add_candidate(id);
+			break;
+		}
+
+		case TypeConstantOp:
+		case TypeUndef:
+			add_candidate(id);
+			break;
+
+		case TypeFunction:
+		{
+			auto &func = get<SPIRFunction>(id);
+			for (auto &arg : func.arguments)
+				add_candidate(arg.id);
+			for (auto &local : func.local_variables)
+				add_candidate(local);
+
+			for (auto block_id : func.blocks)
+			{
+				auto &block = get<SPIRBlock>(block_id);
+				for (auto &i : ir.get_ops(block))
+				{
+					uint32_t result_type, result_id;
+					auto op = static_cast<Op>(i.op);
+					if (instruction_to_result_type(result_type, result_id, op, stream(i), i.length) &&
+					    result_type < ir.ids.size() && result_id < ir.ids.size() &&
+					    ir.ids[result_type].get_type() == TypeType && op != OpVariable && op != OpPhi)
+					{
+						add_candidate(result_id);
+					}
+				}
+			}
+			break;
+		}
+
+		default:
+			break;
+		}
+	}
+
+	// Names which are kept as-is must not be shadowed by a generated one.
+	unordered_set<uint32_t> candidate_set(begin(candidates), end(candidates));
+	unordered_set<string> reserved;
+	for (uint32_t id = 0; id < uint32_t(ir.meta.size()); id++)
+	{
+		auto &alias = ir.meta[id].decoration.alias;
+		if (!alias.empty() && !candidate_set.count(id))
+			reserved.insert(alias);
+	}
+
+	static const char alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+	uint32_t counter = 0;
+	for (auto id : candidates)
+	{
+		if (minified_names.count(id))
+			continue;
+
+		string name;
+		do
+		{
+			// Names take the form _[a-zA-Z][a-zA-Z0-9]*, which never collides with the
+			// _<id> form reserved for temporaries.
+			uint32_t n = counter++;
+			name = "_";
+			name += alphabet[n % 52];
+			n /= 52;
+			while (n)
+			{
+				n--;
+				name += alphabet[n % 62];
+				n /= 62;
+			}
+		} while (reserved.count(name));
+
+		minified_names[id] = move(name);
+	}
+}
+
 void CompilerGLSL::add_header_line(const std::string &line)
 {
 	header_lines.push_back(line);
@@ -9401,7 +10261,7 @@ void CompilerGLSL::emit_function(SPIRFunction &func, const Bitset &return_flags)
 	for (auto block : func.blocks)
 	{
 		auto &b = get<SPIRBlock>(block);
-		for (auto &i : b.ops)
+		for (auto &i : ir.get_ops(b))
 		{
 			auto ops = stream(i);
 			auto op = static_cast<Op>(i.op);
@@ -9415,6 +10275,11 @@ void CompilerGLSL::emit_function(SPIRFunction &func, const Bitset &return_flags)
 		}
 	}
 
+	// Callees are traced on their own, the event only covers the body of this function.
+	TraceScope scope(*this, "emit", "emit_function");
+	if (scope.is_active())
+		scope.add_arg("function", to_name(func.self));
+
 	emit_function_prototype(func, return_flags);
 	begin_scope();
 
@@ -9516,7 +10381,7 @@ void CompilerGLSL::emit_fixup()
 bool CompilerGLSL::flush_phi_required(uint32_t from, uint32_t to)
 {
 	auto &child = get<SPIRBlock>(to);
-	for (auto &phi : child.phi_variables)
+	for (auto &phi : ir.get_phis(child))
 		if (phi.parent == from)
 			return true;
 	return false;
@@ -9526,7 +10391,7 @@ void CompilerGLSL::flush_phi(uint32_t from, uint32_t to)
 {
 	auto &child = get<SPIRBlock>(to);
 
-	for (auto &phi : child.phi_variables)
+	for (auto &phi : ir.get_phis(child))
 	{
 		if (phi.parent == from)
 		{
@@ -9563,16 +10428,18 @@ void CompilerGLSL::branch_to_continue(uint32_t from, uint32_t to)
 	{
 		// Just emit the whole block chain as is.
 		auto usage_counts = expression_usage_counts;
-		auto invalid = invalid_expressions;
+		auto flush_state = flushes;
 
 		emit_block_chain(to_block);
 
-		// Expression usage counts and invalid expressions
+		// Expression usage counts and flushes
 		// are moot after returning from the continue block.
 		// Since we emit the same block multiple times,
 		// we don't want to invalidate ourselves.
+		// The count keeps going, so dependencies taken in the continue block are not mistaken for older ones.
 		expression_usage_counts = usage_counts;
-		invalid_expressions = invalid;
+		flush_state.count = flushes.count;
+		flushes = flush_state;
 	}
 	else
 	{
@@ -9745,7 +10612,7 @@ void CompilerGLSL::propagate_loop_dominators(const SPIRBlock &block)
 		if (block.default_block)
 			set_dominator(block.default_block, dominator);
 
-		for (auto &c : block.cases)
+		for (auto &c : ir.get_cases(block))
 			set_dominator(c.block, dominator);
 
 		// In older glslang output continue_block can be == loop header.
@@ -10250,14 +11117,14 @@ void CompilerGLSL::emit_block_chain(SPIRBlock &block)
 		bool emitted_default = false;
 		unordered_set<uint32_t> emitted_blocks;
 
-		for (auto &c : block.cases)
+		for (auto &c : ir.get_cases(block))
 		{
 			if (emitted_blocks.count(c.block) != 0)
 				continue;
 
 			// Emit all case labels which branch to our target.
 			// FIXME: O(n^2), revisit if we hit shaders with 100++ case labels ...
-			for (auto &other_case : block.cases)
+			for (auto &other_case : ir.get_cases(block))
 			{
 				if (other_case.block == c.block)
 				{
@@ -10424,9 +11291,6 @@ void CompilerGLSL::emit_block_chain(SPIRBlock &block)
 		else
 			emit_block_chain(get<SPIRBlock>(block.merge_block));
 	}
-
-	// Forget about control dependent expressions now.
-	block.invalidate_expressions.clear();
 }
 
 void CompilerGLSL::begin_scope()
@@ -10459,6 +11323,56 @@ void CompilerGLSL::end_scope_decl(const string &decl)
 	statement("} ", decl, ";");
 }
 
+void CompilerGLSL::emit_minified_statement(const string &line)
+{
+	auto is_identifier_char = [](char c) { return isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+	auto is_operator_char = [](char c) { return c != '\0' && strchr("+-*/%<>=!&|^~?:.", c) != nullptr; };
+
+	// Preprocessor directives and comments extend to the end of the line, so keep them on a line of their own.
+	auto first = line.find_first_not_of(' ');
+	if (first == string::npos)
+		return;
+
+	if (line[first] == '#' || line.compare(first, 2, "//") == 0 || line.find('\n') != string::npos)
+	{
+		if (minify_last_char != '\n')
+			(*buffer) << '\n';
+		(*buffer) << line.substr(first) << '\n';
+		minify_last_char = '\n';
+		return;
+	}
+
+	string minified;
+	minified.reserve(line.size() + 1);
+
+	// Two tokens from consecutive statements might need separating as well.
+	char prev = minify_last_char;
+	bool pending_space = prev != '\n';
+	for (size_t i = first; i < line.size(); i++)
+	{
+		char c = line[i];
+		if (c == ' ')
+		{
+			pending_space = true;
+			continue;
+		}
+
+		// Only keep whitespace where removing it would merge two identifiers or two operators.
+		if (pending_space && ((is_identifier_char(prev) && is_identifier_char(c)) ||
+		                      (is_operator_char(prev) && is_operator_char(c))))
+		{
+			minified += ' ';
+		}
+
+		pending_space = false;
+		minified += c;
+		prev = c;
+	}
+
+	(*buffer) << minified;
+	minify_last_char = prev;
+}
+
 void CompilerGLSL::check_function_call_constraints(const uint32_t *args, uint32_t length)
 {
 	// If our variable is remapped, and we rely on type-remapping information as
@@ -10485,9 +11399,10 @@ void CompilerGLSL::check_function_call_constraints(const uint32_t *args, uint32_
 const Instruction *CompilerGLSL::get_next_instruction_in_block(const Instruction &instr)
 {
 	// FIXME: This is kind of hacky. There should be a cleaner way.
-	auto offset = uint32_t(&instr - current_emitting_block->ops.data());
-	if ((offset + 1) < current_emitting_block->ops.size())
-		return &current_emitting_block->ops[offset + 1];
+	auto ops = ir.get_ops(*current_emitting_block);
+	auto offset = uint32_t(&instr - ops.begin());
+	if ((offset + 1) < ops.size())
+		return &ops[offset + 1];
 	else
 		return nullptr;
 }
@@ -87,6 +87,18 @@ public:
 		// If disabled on older targets, binding decorations will be stripped.
 		bool enable_420pack_extension = true;
 
+		// Emits GLSL with as little whitespace as possible: no indentation, no blank lines,
+		// and no line breaks except where the preprocessor requires them.
+		// This reduces the size of the shader source and the time a driver spends parsing it.
+		bool minify = false;
+
+		// Renames function local variables, temporaries and non-interface globals
+		// (Private and Workgroup variables, constant arrays and specialization constant expressions)
+		// to short, deterministic identifiers.
+		// Interface variables, blocks, struct types and functions keep their names,
+		// so reflection on the generated source is unaffected.
+		bool minify_identifiers = false;
+
 		enum Precision
 		{
 			DontCare,
@@ -151,6 +163,15 @@ public:
 		init();
 	}
 
+	// Replaces the module with a new one, as if the compiler was constructed again for it.
+	// Containers are cleared rather than freed, so a compiler reused for a stream of modules
+	// settles at few allocations per module.
+	// Options return to their defaults for the new module. The trace recorder, compile cache,
+	// stats and layout patching settings are kept.
+	// If parsing fails, the compiler holds no module until a later reset() succeeds.
+	void reset(std::vector<uint32_t> spirv);
+	void reset(const uint32_t *spirv, size_t word_count);
+
 	// Deprecate this interface because it doesn't overload properly with subclasses.
 	// Requires awkward static casting, which was a mistake.
 	SPIRV_CROSS_DEPRECATED("get_options() is obsolete, use get_common_options() instead.")
@@ -179,6 +200,41 @@ public:
 
 	std::string compile() override;
 
+	// Compiles the shader once per set of specialization constant values.
+	// The module is analyzed only once, then for every set the constants are patched in place and the source
+	// is emitted again. Specialization constants which are not part of a set keep their default value.
+	// Specialization constant ops which only depend on scalar integer or boolean constants are folded to literals,
+	// so the outputs assume the values are final.
+	// The default values are restored before returning.
+	std::vector<std::string> compile_specialization_variants(
+	    const std::vector<std::vector<SpecializationConstantValue>> &variants);
+
+	// Compiles the shader once per set of options, e.g. for several GLSL versions or ES and desktop profiles.
+	// The option-independent analysis is only done once. Every profile starts from the backend state and
+	// extensions the compiler had before the call, so the outputs are the same as with a fresh compiler per profile.
+	// The options are restored before returning.
+	std::vector<std::string> compile_all(const std::vector<Options> &profiles);
+
+	// Looks up the output of compile() in cache before compiling, and stores it there afterwards.
+	// Entries are keyed by get_compile_cache_key(). nullptr disables caching, which is the default.
+	// The cache is not owned by the compiler and must outlive it, or be detached first.
+	void set_compile_cache(CompileCache *cache)
+	{
+		compile_cache = cache;
+	}
+
+	CompileCache *get_compile_cache() const
+	{
+		return compile_cache;
+	}
+
+	// Makes compile() record where the values of layout(binding, set, location) qualifiers end up in the output.
+	// If only the values of Binding, DescriptorSet and Location decorations change until the next compile(),
+	// the recorded output is patched with the new values instead of compiled again.
+	// Any other change, including adding or removing one of these decorations, falls back to a full compile.
+	// Legacy targets emit no layout qualifiers and always compile in full.
+	void set_layout_patching_enabled(bool enable);
+
 	// Returns the current string held in the conversion buffer. Useful for
 	// capturing what has been converted so far when compile() throws an error.
 	std::string get_partial_source();
@@ -208,6 +264,53 @@ public:
 
 protected:
 	void reset();
+	void reset_compiler_state();
+
+	CompileCache *compile_cache = nullptr;
+	// compile() writes deduplicated names back to the IR, so the compiler it leaves behind has a different key
+	// than the one it started from, for the same output. The key of the last compile and the key of the state it left.
+	std::string compiled_cache_key;
+	std::string compiled_state_key;
+	void append_compile_cache_key(CompileCacheKey &key, bool layout_values) const override;
+	void append_memory_footprint(CompilerMemoryFootprint &footprint) const override;
+	void invalidate_declared_layouts() override;
+	void set_declared_member_packing(const SPIRType &type, uint32_t index, BufferLayoutMember &member) const override;
+
+	struct LayoutPatchSlot
+	{
+		uint32_t id;
+		// ~0u for decorations on the ID itself.
+		uint32_t member;
+		spv::Decoration decoration;
+		size_t offset;
+		size_t length;
+	};
+
+	bool layout_patching = false;
+	// Only set while compile() emits, so other backends never see the markers.
+	bool recording_layout_patch = false;
+	// Filled in while emitting, the output refers to these by index.
+	std::vector<LayoutPatchSlot> layout_patch_slots;
+	// The last full compile, with the recorded values cut out at the slot offsets.
+	std::vector<LayoutPatchSlot> layout_patch_source_slots;
+	std::string layout_patch_source;
+	// Unhashed compile cache key of the last full compile, without the layout values.
+	std::string layout_patch_key;
+
+	std::string layout_value(uint32_t id, uint32_t member, spv::Decoration decoration, uint32_t value);
+	std::string extract_layout_patch_slots(const std::string &source);
+	std::string patch_layout_values() const;
+
+	// Analysis passes of compile() which only depend on the module, not on the options or constant values.
+	void analyze_module_for_compile();
+
+	// Set by compile_specialization_variants() and compile_all() once the module has been analyzed.
+	bool reuse_module_analysis = false;
+
+	// Set by compile_specialization_variants() while compiling variants.
+	bool fold_specialization_constant_ops = false;
+	bool fold_constant_op(const SPIRConstantOp &cop, uint32_t &value) const;
+	bool get_foldable_scalar(uint32_t id, uint32_t &value) const;
 	void emit_function(SPIRFunction &func, const Bitset &return_flags);
 
 	bool has_extension(const std::string &ext) const;
@@ -290,8 +393,16 @@ protected:
 			return;
 		}
 
+		if (stats_enabled)
+			stats.statements_emitted++;
+
 		if (redirect_statement)
 			redirect_statement->push_back(join(std::forward<Ts>(ts)...));
+		else if (options.minify)
+		{
+			statement_count++;
+			emit_minified_statement(join(std::forward<Ts>(ts)...));
+		}
 		else
 		{
 			for (uint32_t i = 0; i < indent; i++)
@@ -310,6 +421,11 @@ protected:
 		indent = old_indent;
 	}
 
+	// Writes a statement with redundant whitespace stripped.
+	// Line breaks are only kept around preprocessor directives and comments.
+	void emit_minified_statement(const std::string &line);
+	char minify_last_char = '\n';
+
 	// Used for implementing continue blocks where
 	// we want to obtain a list of statements we can merge
 	// on a single line separated by comma.
@@ -494,11 +610,24 @@ protected:
 	virtual std::string to_initializer_expression(const SPIRVariable &var);
 
 	bool buffer_is_packing_standard(const SPIRType &type, BufferPackingStandard packing, uint32_t start_offset = 0,
-	                                uint32_t end_offset = ~(0u));
-	uint32_t type_to_packed_base_size(const SPIRType &type, BufferPackingStandard packing);
-	uint32_t type_to_packed_alignment(const SPIRType &type, const Bitset &flags, BufferPackingStandard packing);
-	uint32_t type_to_packed_array_stride(const SPIRType &type, const Bitset &flags, BufferPackingStandard packing);
-	uint32_t type_to_packed_size(const SPIRType &type, const Bitset &flags, BufferPackingStandard packing);
+	                                uint32_t end_offset = ~(0u)) const;
+	bool buffer_is_packing_standard_uncached(const SPIRType &type, BufferPackingStandard packing,
+	                                         uint32_t start_offset, uint32_t end_offset) const;
+	bool member_is_packing_standard(const SPIRType &type, uint32_t index, uint32_t offset,
+	                                BufferPackingStandard packing) const;
+	uint32_t type_to_packed_base_size(const SPIRType &type, BufferPackingStandard packing) const;
+	uint32_t type_to_packed_alignment(const SPIRType &type, const Bitset &flags,
+	                                  BufferPackingStandard packing) const;
+	uint32_t type_to_packed_array_stride(const SPIRType &type, const Bitset &flags,
+	                                     BufferPackingStandard packing) const;
+	uint32_t type_to_packed_size(const SPIRType &type, const Bitset &flags, BufferPackingStandard packing) const;
+
+	// Packing of a struct only depends on the struct and the packing standard,
+	// so results are remembered for the duration of a compile(). Keyed by get_packing_cache_key().
+	mutable std::unordered_map<uint64_t, uint32_t> packed_struct_alignment_cache;
+	mutable std::unordered_map<uint64_t, uint32_t> packed_struct_size_cache;
+	mutable std::unordered_map<uint64_t, bool> packing_standard_cache;
+	static uint64_t get_packing_cache_key(const SPIRType &type, BufferPackingStandard packing);
 
 	std::string bitcast_glsl(const SPIRType &result_type, uint32_t arg);
 	virtual std::string bitcast_glsl_op(const SPIRType &result_type, const SPIRType &argument_type);
@@ -515,10 +644,17 @@ protected:
 	bool check_atomic_image(uint32_t id);
 
 	virtual void replace_illegal_names();
+
+	std::string to_name(uint32_t id, bool allow_alias = true) const override;
+	void build_minified_names();
+	std::unordered_map<uint32_t, std::string> minified_names;
 	virtual void emit_entry_point_declarations();
 
 	void replace_fragment_output(SPIRVariable &var);
 	void replace_fragment_outputs();
+	// Undoes replace_fragment_outputs() when a later compile targets a non-legacy profile.
+	void restore_fragment_outputs();
+	std::unordered_map<uint32_t, std::string> replaced_fragment_output_aliases;
 	bool check_explicit_lod_allowed(uint32_t lod);
 	std::string legacy_tex_op(const std::string &op, const SPIRType &imgtype, uint32_t lod, uint32_t id);
 
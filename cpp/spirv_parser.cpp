@@ -15,7 +15,10 @@
  */
 
 #include "spirv_parser.hpp"
+#include <algorithm>
 #include <assert.h>
+#include <system_error>
+#include <thread>
 
 using namespace std;
 using namespace spv;
@@ -32,6 +35,25 @@ Parser::Parser(const uint32_t *spirv_data, size_t word_count)
 	ir.spirv = vector<uint32_t>(spirv_data, spirv_data + word_count);
 }
 
+Parser::Parser(ParsedIR &&ir_, const uint32_t *spirv_data, size_t word_count)
+    : ir(move(ir_))
+{
+	ir.reset();
+	ir.spirv.assign(spirv_data, spirv_data + word_count);
+}
+
+Parser::Parser(ParsedIR &&ir_, std::vector<uint32_t> spirv)
+    : ir(move(ir_))
+{
+	ir.reset();
+	ir.spirv = move(spirv);
+}
+
+Parser::Parser(ParsedIR &&ir_)
+    : ir(move(ir_))
+{
+}
+
 static bool decoration_is_string(Decoration decoration)
 {
 	switch (decoration)
@@ -66,58 +88,406 @@ static bool is_valid_spirv_version(uint32_t version)
 	}
 }
 
-void Parser::parse()
+template <bool swap>
+static void scan_words(vector<uint32_t> &spirv, InstructionScan &scan)
 {
-	auto &spirv = ir.spirv;
+	auto *words = spirv.data();
+	size_t len = spirv.size();
+	size_t offset = 5;
+	while (offset < len)
+	{
+		uint32_t header = swap ? swap_endian(words[offset]) : words[offset];
+		uint32_t op = header & 0xffff;
+		uint32_t count = header >> 16;
 
-	auto len = spirv.size();
-	if (len < 5)
-		SPIRV_CROSS_THROW("SPIRV file too small.");
+		if (count == 0)
+			SPIRV_CROSS_THROW("SPIR-V instructions cannot consume 0 words. Invalid SPIR-V file.");
+		if (count > len - offset)
+			SPIRV_CROSS_THROW("SPIR-V instruction goes out of bounds.");
+
+		if (swap)
+			for (size_t i = offset; i < offset + count; i++)
+				words[i] = swap_endian(words[i]);
+
+		Instruction instr = {};
+		instr.op = uint16_t(op);
+		instr.length = uint16_t(count - 1);
+		instr.offset = uint32_t(offset + 1);
+		scan.instructions.push_back(instr);
+		scan.opcode_counts[op < InstructionScan::OpcodeCountLimit ? op : InstructionScan::OpcodeCountLimit - 1]++;
+
+		offset += count;
+	}
+}
 
-	auto s = spirv.data();
+void scan_instructions(vector<uint32_t> &spirv, InstructionScan &scan)
+{
+	if (spirv.size() < 5)
+		SPIRV_CROSS_THROW("SPIRV file too small.");
 
 	// Endian-swap if we need to.
-	if (s[0] == swap_endian(MagicNumber))
-		transform(begin(spirv), end(spirv), begin(spirv), [](uint32_t c) { return swap_endian(c); });
+	bool swap = spirv[0] == swap_endian(MagicNumber);
+	if (swap)
+		for (uint32_t i = 0; i < 5; i++)
+			spirv[i] = swap_endian(spirv[i]);
 
-	if (s[0] != MagicNumber || !is_valid_spirv_version(s[1]))
+	if (spirv[0] != MagicNumber || !is_valid_spirv_version(spirv[1]))
 		SPIRV_CROSS_THROW("Invalid SPIRV format.");
 
-	uint32_t bound = s[3];
-	ir.set_id_bounds(bound);
-
-	uint32_t offset = 5;
+	if (swap)
+		scan_words<true>(spirv, scan);
+	else
+		scan_words<false>(spirv, scan);
+}
 
-	vector<Instruction> instructions;
-	while (offset < len)
-	{
-		Instruction instr = {};
-		instr.op = spirv[offset] & 0xffff;
-		instr.count = (spirv[offset] >> 16) & 0xffff;
+void Parser::parse()
+{
+	InstructionScan scan;
+	scan_instructions(ir.spirv, scan);
+	auto &instructions = scan.instructions;
 
-		if (instr.count == 0)
-			SPIRV_CROSS_THROW("SPIR-V instructions cannot consume 0 words. Invalid SPIR-V file.");
+	ir.set_id_bounds(ir.spirv[3]);
 
-		instr.offset = offset + 1;
-		instr.length = instr.count - 1;
+	// Lazy parses skip most functions, so they are not worth spreading over threads.
+	uint32_t threads = thread_count ? thread_count : max(thread::hardware_concurrency(), 1u);
+	if (lazy_function_parsing)
+		threads = 1;
 
-		offset += instr.count;
+	// Every block starts with OpLabel and ends with exactly one terminator, neither of which is an op,
+	// so the function bodies bound the ops array. Lazy parses leave most of it unused.
+	if (!lazy_function_parsing)
+	{
+		auto first_function = find_if(begin(instructions), end(instructions),
+		                              [](const Instruction &instr) { return instr.op == OpFunction; });
+		size_t body_instructions = size_t(end(instructions) - first_function);
+		size_t structure = scan.get_opcode_count(OpFunction) + scan.get_opcode_count(OpFunctionParameter) +
+		                   scan.get_opcode_count(OpFunctionEnd) + 2 * size_t(scan.get_opcode_count(OpLabel));
+		if (body_instructions > structure)
+			ir.block_ops.reserve(body_instructions - structure);
+	}
 
-		if (offset > spirv.size())
-			SPIRV_CROSS_THROW("SPIR-V instruction goes out of bounds.");
+	vector<size_t> functions;
+	if (threads > 1 && scan.get_opcode_count(OpFunction) > 1)
+	{
+		functions.reserve(scan.get_opcode_count(OpFunction));
+		for (size_t i = 0; i < instructions.size(); i++)
+			if (instructions[i].op == OpFunction)
+				functions.push_back(i);
+	}
 
-		instructions.push_back(instr);
+	ParseState state;
+	size_t start = 0;
+	if (functions.size() > 1)
+	{
+		for (; start < functions.front(); start++)
+			parse(state, instructions[start]);
+		start = parse_functions(state, instructions, functions, threads);
 	}
 
-	for (auto &i : instructions)
-		parse(i);
+	size_t i = start;
+	while (i < instructions.size())
+	{
+		if (lazy_function_parsing && instructions[i].op == OpFunction && !state.current_function)
+		{
+			size_t next = skip_function(instructions, i);
+			if (next != i)
+			{
+				i = next;
+				continue;
+			}
+		}
+		parse(state, instructions[i++]);
+	}
 
-	if (current_function)
+	if (state.current_function)
 		SPIRV_CROSS_THROW("Function was not terminated.");
-	if (current_block)
+	if (state.current_block)
 		SPIRV_CROSS_THROW("Block was not terminated.");
 }
 
+void Parser::set_thread_count(uint32_t count)
+{
+	thread_count = count;
+}
+
+void Parser::set_lazy_function_parsing(bool enable)
+{
+	lazy_function_parsing = enable;
+}
+
+// Opcodes parse() handles by modifying the IR outside of the IDs they declare.
+// Function bodies only contain them in unusual modules, which are parsed serially from there on.
+static bool opcode_modifies_globals(Op op)
+{
+	switch (op)
+	{
+	case OpSource:
+	case OpCapability:
+	case OpExtension:
+	case OpExtInstImport:
+	case OpEntryPoint:
+	case OpExecutionMode:
+	case OpName:
+	case OpMemberName:
+	case OpGroupDecorate:
+	case OpGroupMemberDecorate:
+	case OpDecorate:
+	case OpDecorateId:
+	case OpDecorateStringGOOGLE:
+	case OpMemberDecorate:
+	case OpMemberDecorateStringGOOGLE:
+	case OpTypeVoid:
+	case OpTypeBool:
+	case OpTypeFloat:
+	case OpTypeInt:
+	case OpTypeVector:
+	case OpTypeMatrix:
+	case OpTypeArray:
+	case OpTypeRuntimeArray:
+	case OpTypeImage:
+	case OpTypeSampledImage:
+	case OpTypeSampler:
+	case OpTypePointer:
+	case OpTypeStruct:
+	case OpTypeFunction:
+	case OpSpecConstant:
+	case OpConstant:
+	case OpSpecConstantFalse:
+	case OpConstantFalse:
+	case OpSpecConstantTrue:
+	case OpConstantTrue:
+	case OpConstantNull:
+	case OpSpecConstantComposite:
+	case OpConstantComposite:
+	case OpSpecConstantOp:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+size_t Parser::parse_functions(ParseState &state, const vector<Instruction> &instructions,
+                               const vector<size_t> &functions, uint32_t threads)
+{
+	// Split the functions into runs with about the same number of instructions.
+	size_t first = functions.front();
+	size_t total = instructions.size() - first;
+	size_t run_count = min(size_t(threads), functions.size());
+
+	vector<size_t> bounds;
+	bounds.reserve(run_count + 1);
+	bounds.push_back(first);
+	for (auto function : functions)
+	{
+		if (bounds.size() == run_count)
+			break;
+		if (function - first >= total * bounds.size() / run_count)
+			bounds.push_back(function);
+	}
+	bounds.push_back(instructions.size());
+	run_count = bounds.size() - 1;
+
+	// Runs only read the IR, which holds nothing but the global declarations at this point.
+	vector<ParseState> states(run_count);
+	auto parse_run_caught = [&](size_t run) {
+		auto &run_state = states[run];
+		run_state.deferred = true;
+#ifdef SPIRV_CROSS_EXCEPTIONS_TO_ASSERTIONS
+		parse_run(run_state, instructions, bounds[run], bounds[run + 1]);
+#else
+		try
+		{
+			parse_run(run_state, instructions, bounds[run], bounds[run + 1]);
+		}
+		catch (...)
+		{
+			run_state.error = current_exception();
+		}
+#endif
+	};
+
+	vector<thread> workers;
+	workers.reserve(run_count - 1);
+	size_t run = 1;
+#ifndef SPIRV_CROSS_EXCEPTIONS_TO_ASSERTIONS
+	try
+#endif
+	{
+		for (; run < run_count; run++)
+			workers.emplace_back(parse_run_caught, run);
+	}
+#ifndef SPIRV_CROSS_EXCEPTIONS_TO_ASSERTIONS
+	catch (const system_error &)
+	{
+		// Out of threads, parse the remaining runs here.
+	}
+#endif
+
+	parse_run_caught(0);
+	for (; run < run_count; run++)
+		parse_run_caught(run);
+	for (auto &worker : workers)
+		worker.join();
+
+	// A run which stopped early or left a function open is where serial parsing picks up,
+	// the runs after it are discarded.
+	for (run = 0; run < run_count; run++)
+	{
+		auto &run_state = states[run];
+		merge_run(run_state);
+		state.current_function = run_state.current_function;
+		state.current_block = run_state.current_block;
+
+		if (run_state.error)
+			rethrow_exception(run_state.error);
+		if (run_state.stop != bounds[run + 1] || state.current_function)
+			return run_state.stop;
+	}
+
+	return instructions.size();
+}
+
+void Parser::parse_run(ParseState &state, const vector<Instruction> &instructions, size_t begin, size_t end)
+{
+	for (state.stop = begin; state.stop < end; state.stop++)
+	{
+		auto &instruction = instructions[state.stop];
+		if (opcode_modifies_globals(static_cast<Op>(instruction.op)))
+			break;
+		parse(state, instruction);
+	}
+}
+
+template <typename T>
+static void append_run(vector<T> &array, const vector<T> &run_array)
+{
+	array.insert(end(array), begin(run_array), end(run_array));
+}
+
+static void rebase_span(BlockSpan &span, size_t base)
+{
+	if (!span.empty())
+		span.offset += uint32_t(base);
+}
+
+void Parser::merge_run(ParseState &state)
+{
+	for (auto &id : state.ids)
+	{
+		if (id.type == TypeBlock)
+		{
+			auto &block = static_cast<SPIRBlock &>(*id.value);
+			rebase_span(block.ops, ir.block_ops.size());
+			rebase_span(block.phi_variables, ir.block_phis.size());
+			rebase_span(block.cases, ir.block_cases.size());
+		}
+
+		ir.ids.at(id.id).set(move(id.value), id.type);
+	}
+
+	append_run(ir.block_ops, state.block_ops);
+	append_run(ir.block_phis, state.block_phis);
+	append_run(ir.block_cases, state.block_cases);
+
+	for (auto &meta : state.block_meta)
+		ir.block_meta[meta.first] |= meta.second;
+	for (auto &loop : state.continue_block_to_loop_header)
+		ir.continue_block_to_loop_header[loop.first] = loop.second;
+	for (auto id : state.image_variables)
+	{
+		ir.set_decoration(id, DecorationNonWritable);
+		ir.set_decoration(id, DecorationNonReadable);
+	}
+}
+
+size_t Parser::skip_function(const vector<Instruction> &instructions, size_t begin)
+{
+	auto &function = instructions[begin];
+	if (function.length < 4)
+		return begin;
+
+	// Functions which reuse an ID are parsed now, so they fail or overwrite it the way they would in a full parse.
+	uint32_t id = ir.spirv[function.offset + 1];
+	if (id >= ir.ids.size() || ir.ids[id].get_type() != TypeNone || ir.unparsed_functions.count(id))
+		return begin;
+
+	for (size_t i = begin + 1; i < instructions.size(); i++)
+	{
+		auto op = static_cast<Op>(instructions[i].op);
+		if (op == OpFunctionEnd)
+		{
+			uint32_t offset = function.offset - 1;
+			uint32_t end_offset = instructions[i].offset + instructions[i].length;
+			ir.unparsed_functions[id] = { offset, end_offset - offset };
+			return i + 1;
+		}
+		else if (op == OpFunction || opcode_modifies_globals(op))
+			break;
+	}
+
+	return begin;
+}
+
+vector<uint32_t> Parser::parse_function(uint32_t id)
+{
+	vector<uint32_t> parsed;
+	if (ir.unparsed_functions.empty())
+		return parsed;
+
+	// Parsed functions may call skipped ones as well, so the whole call graph is walked.
+	vector<bool> visited(ir.ids.size());
+	vector<uint32_t> pending = { id };
+	while (!pending.empty())
+	{
+		uint32_t function = pending.back();
+		pending.pop_back();
+		if (function >= visited.size() || visited[function])
+			continue;
+		visited[function] = true;
+
+		auto itr = ir.unparsed_functions.find(function);
+		if (itr != end(ir.unparsed_functions))
+		{
+			uint32_t offset = itr->second.offset;
+			uint32_t end_offset = offset + itr->second.count;
+			ir.unparsed_functions.erase(itr);
+			parsed.push_back(function);
+
+			// parse() checked the instructions are in bounds already.
+			ParseState state;
+			while (offset < end_offset)
+			{
+				Instruction instr = {};
+				instr.op = ir.spirv[offset] & 0xffff;
+				instr.length = uint16_t((ir.spirv[offset] >> 16) - 1);
+				instr.offset = offset + 1;
+				parse(state, instr);
+				offset += instr.length + 1u;
+			}
+		}
+
+		auto *func = maybe_get<SPIRFunction>(function);
+		if (!func)
+			continue;
+
+		for (auto block : func->blocks)
+			for (auto &op : ir.get_ops(get<SPIRBlock>(block)))
+				if (op.op == OpFunctionCall && op.length >= 3)
+					pending.push_back(ir.spirv[op.offset + 2]);
+	}
+
+	return parsed;
+}
+
+void Parser::set_block_meta(ParseState &state, uint32_t block, ParsedIR::BlockMetaFlags flags)
+{
+	if (state.deferred)
+		state.block_meta.emplace_back(block, flags);
+	else
+		ir.block_meta[block] |= flags;
+}
+
 const uint32_t *Parser::stream(const Instruction &instr) const
 {
 	// If we're not going to use any arguments, just return nullptr.
@@ -131,6 +501,17 @@ const uint32_t *Parser::stream(const Instruction &instr) const
 	return &ir.spirv[instr.offset];
 }
 
+// Blocks only grow while they are the current block, and the next block starts at the end of the arrays,
+// so the span of a block is always the tail of the array when an element is added.
+template <typename T>
+static void append_to_block(vector<T> &array, BlockSpan &span, const T &value)
+{
+	if (span.empty())
+		span.offset = uint32_t(array.size());
+	array.push_back(value);
+	span.count++;
+}
+
 static string extract_string(const vector<uint32_t> &spirv, uint32_t offset)
 {
 	string ret;
@@ -150,7 +531,7 @@ static string extract_string(const vector<uint32_t> &spirv, uint32_t offset)
 	SPIRV_CROSS_THROW("String was not terminated before EOF");
 }
 
-void Parser::parse(const Instruction &instruction)
+void Parser::parse(ParseState &state, const Instruction &instruction)
 {
 	auto *ops = stream(instruction);
 	auto op = static_cast<Op>(instruction.op);
@@ -206,7 +587,7 @@ void Parser::parse(const Instruction &instruction)
 	{
 		uint32_t result_type = ops[0];
 		uint32_t id = ops[1];
-		set<SPIRUndef>(id, result_type);
+		set<SPIRUndef>(state, id, result_type);
 		break;
 	}
 
@@ -631,13 +1012,21 @@ void Parser::parse(const Instruction &instruction)
 		// For stripped names, never consider struct type aliasing.
 		// We risk declaring the same struct multiple times, but type-punning is not allowed
 		// so this is safe.
-		bool consider_aliasing = !ir.get_name(type.self).empty();
+		auto &name = ir.get_name(type.self);
+		bool consider_aliasing = !name.empty();
 		if (consider_aliasing)
 		{
-			for (auto &other : global_struct_cache)
+			Hasher hasher;
+			uint64_t type_hash = get_type_hash(id);
+			hasher.u32(uint32_t(type_hash));
+			hasher.u32(uint32_t(type_hash >> 32));
+			for (auto c : name)
+				hasher.u32(uint8_t(c));
+
+			auto &candidates = global_struct_cache[hasher.get()];
+			for (auto &other : candidates)
 			{
-				if (ir.get_name(type.self) == ir.get_name(other) &&
-				    types_are_logically_equivalent(type, get<SPIRType>(other)))
+				if (name == ir.get_name(other) && types_are_logically_equivalent(type, get<SPIRType>(other)))
 				{
 					type.type_alias = other;
 					break;
@@ -645,7 +1034,7 @@ void Parser::parse(const Instruction &instruction)
 			}
 
 			if (type.type_alias == 0)
-				global_struct_cache.push_back(id);
+				candidates.push_back(id);
 		}
 		break;
 	}
@@ -672,19 +1061,24 @@ void Parser::parse(const Instruction &instruction)
 
 		if (storage == StorageClassFunction)
 		{
-			if (!current_function)
+			if (!state.current_function)
 				SPIRV_CROSS_THROW("No function currently in scope");
-			current_function->add_local_variable(id);
+			state.current_function->add_local_variable(id);
 		}
 
-		set<SPIRVariable>(id, type, storage, initializer);
+		set<SPIRVariable>(state, id, type, storage, initializer);
 
 		// hlsl based shaders don't have those decorations. force them and then reset when reading/writing images
 		auto &ttype = get<SPIRType>(type);
 		if (ttype.basetype == SPIRType::BaseType::Image)
 		{
-			ir.set_decoration(id, DecorationNonWritable);
-			ir.set_decoration(id, DecorationNonReadable);
+			if (state.deferred)
+				state.image_variables.push_back(id);
+			else
+			{
+				ir.set_decoration(id, DecorationNonWritable);
+				ir.set_decoration(id, DecorationNonReadable);
+			}
 		}
 
 		break;
@@ -697,22 +1091,23 @@ void Parser::parse(const Instruction &instruction)
 	// variable to emulate SSA Phi.
 	case OpPhi:
 	{
-		if (!current_function)
+		if (!state.current_function)
 			SPIRV_CROSS_THROW("No function currently in scope");
-		if (!current_block)
+		if (!state.current_block)
 			SPIRV_CROSS_THROW("No block currently in scope");
 
 		uint32_t result_type = ops[0];
 		uint32_t id = ops[1];
 
 		// Instead of a temporary, create a new function-wide temporary with this ID instead.
-		auto &var = set<SPIRVariable>(id, result_type, spv::StorageClassFunction);
+		auto &var = set<SPIRVariable>(state, id, result_type, spv::StorageClassFunction);
 		var.phi_variable = true;
 
-		current_function->add_local_variable(id);
+		state.current_function->add_local_variable(id);
 
 		for (uint32_t i = 2; i + 2 <= length; i += 2)
-			current_block->phi_variables.push_back({ ops[i], ops[i + 1], id });
+			append_to_block(state.deferred ? state.block_phis : ir.block_phis, state.current_block->phi_variables,
+			                { ops[i], ops[i + 1], id });
 		break;
 	}
 
@@ -810,10 +1205,10 @@ void Parser::parse(const Instruction &instruction)
 		// Control
 		uint32_t type = ops[3];
 
-		if (current_function)
+		if (state.current_function)
 			SPIRV_CROSS_THROW("Must end a function before starting a new one!");
 
-		current_function = &set<SPIRFunction>(id, res, type);
+		state.current_function = &set<SPIRFunction>(state, id, res, type);
 		break;
 	}
 
@@ -822,24 +1217,24 @@ void Parser::parse(const Instruction &instruction)
 		uint32_t type = ops[0];
 		uint32_t id = ops[1];
 
-		if (!current_function)
+		if (!state.current_function)
 			SPIRV_CROSS_THROW("Must be in a function!");
 
-		current_function->add_parameter(type, id);
-		set<SPIRVariable>(id, type, StorageClassFunction);
+		state.current_function->add_parameter(type, id);
+		set<SPIRVariable>(state, id, type, StorageClassFunction);
 		break;
 	}
 
 	case OpFunctionEnd:
 	{
-		if (current_block)
+		if (state.current_block)
 		{
 			// Very specific error message, but seems to come up quite often.
 			SPIRV_CROSS_THROW(
 			    "Cannot end a function before ending the current block.\n"
 			    "Likely cause: If this SPIR-V was created from glslang HLSL, make sure the entry point is valid.");
 		}
-		current_function = nullptr;
+		state.current_function = nullptr;
 		break;
 	}
 
@@ -847,154 +1242,159 @@ void Parser::parse(const Instruction &instruction)
 	case OpLabel:
 	{
 		// OpLabel always starts a block.
-		if (!current_function)
+		if (!state.current_function)
 			SPIRV_CROSS_THROW("Blocks cannot exist outside functions!");
 
 		uint32_t id = ops[0];
 
-		current_function->blocks.push_back(id);
-		if (!current_function->entry_block)
-			current_function->entry_block = id;
+		state.current_function->blocks.push_back(id);
+		if (!state.current_function->entry_block)
+			state.current_function->entry_block = id;
 
-		if (current_block)
+		if (state.current_block)
 			SPIRV_CROSS_THROW("Cannot start a block before ending the current block.");
 
-		current_block = &set<SPIRBlock>(id);
+		state.current_block = &set<SPIRBlock>(state, id);
 		break;
 	}
 
 	// Branch instructions end blocks.
 	case OpBranch:
 	{
-		if (!current_block)
+		if (!state.current_block)
 			SPIRV_CROSS_THROW("Trying to end a non-existing block.");
 
 		uint32_t target = ops[0];
-		current_block->terminator = SPIRBlock::Direct;
-		current_block->next_block = target;
-		current_block = nullptr;
+		state.current_block->terminator = SPIRBlock::Direct;
+		state.current_block->next_block = target;
+		state.current_block = nullptr;
 		break;
 	}
 
 	case OpBranchConditional:
 	{
-		if (!current_block)
+		if (!state.current_block)
 			SPIRV_CROSS_THROW("Trying to end a non-existing block.");
 
-		current_block->condition = ops[0];
-		current_block->true_block = ops[1];
-		current_block->false_block = ops[2];
+		state.current_block->condition = ops[0];
+		state.current_block->true_block = ops[1];
+		state.current_block->false_block = ops[2];
 
-		current_block->terminator = SPIRBlock::Select;
-		current_block = nullptr;
+		state.current_block->terminator = SPIRBlock::Select;
+		state.current_block = nullptr;
 		break;
 	}
 
 	case OpSwitch:
 	{
-		if (!current_block)
+		if (!state.current_block)
 			SPIRV_CROSS_THROW("Trying to end a non-existing block.");
 
-		if (current_block->merge == SPIRBlock::MergeNone)
+		if (state.current_block->merge == SPIRBlock::MergeNone)
 			SPIRV_CROSS_THROW("Switch statement is not structured");
 
-		current_block->terminator = SPIRBlock::MultiSelect;
+		state.current_block->terminator = SPIRBlock::MultiSelect;
 
-		current_block->condition = ops[0];
-		current_block->default_block = ops[1];
+		state.current_block->condition = ops[0];
+		state.current_block->default_block = ops[1];
 
 		for (uint32_t i = 2; i + 2 <= length; i += 2)
-			current_block->cases.push_back({ ops[i], ops[i + 1] });
+			append_to_block(state.deferred ? state.block_cases : ir.block_cases, state.current_block->cases,
+			                { ops[i], ops[i + 1] });
 
 		// If we jump to next block, make it break instead since we're inside a switch case block at that point.
-		ir.block_meta[current_block->next_block] |= ParsedIR::BLOCK_META_MULTISELECT_MERGE_BIT;
+		set_block_meta(state, state.current_block->next_block, ParsedIR::BLOCK_META_MULTISELECT_MERGE_BIT);
 
-		current_block = nullptr;
+		state.current_block = nullptr;
 		break;
 	}
 
 	case OpKill:
 	{
-		if (!current_block)
+		if (!state.current_block)
 			SPIRV_CROSS_THROW("Trying to end a non-existing block.");
-		current_block->terminator = SPIRBlock::Kill;
-		current_block = nullptr;
+		state.current_block->terminator = SPIRBlock::Kill;
+		state.current_block = nullptr;
 		break;
 	}
 
 	case OpReturn:
 	{
-		if (!current_block)
+		if (!state.current_block)
 			SPIRV_CROSS_THROW("Trying to end a non-existing block.");
-		current_block->terminator = SPIRBlock::Return;
-		current_block = nullptr;
+		state.current_block->terminator = SPIRBlock::Return;
+		state.current_block = nullptr;
 		break;
 	}
 
 	case OpReturnValue:
 	{
-		if (!current_block)
+		if (!state.current_block)
 			SPIRV_CROSS_THROW("Trying to end a non-existing block.");
-		current_block->terminator = SPIRBlock::Return;
-		current_block->return_value = ops[0];
-		current_block = nullptr;
+		state.current_block->terminator = SPIRBlock::Return;
+		state.current_block->return_value = ops[0];
+		state.current_block = nullptr;
 		break;
 	}
 
 	case OpUnreachable:
 	{
-		if (!current_block)
+		if (!state.current_block)
 			SPIRV_CROSS_THROW("Trying to end a non-existing block.");
-		current_block->terminator = SPIRBlock::Unreachable;
-		current_block = nullptr;
+		state.current_block->terminator = SPIRBlock::Unreachable;
+		state.current_block = nullptr;
 		break;
 	}
 
 	case OpSelectionMerge:
 	{
-		if (!current_block)
+		if (!state.current_block)
 			SPIRV_CROSS_THROW("Trying to modify a non-existing block.");
 
-		current_block->next_block = ops[0];
-		current_block->merge = SPIRBlock::MergeSelection;
-		ir.block_meta[current_block->next_block] |= ParsedIR::BLOCK_META_SELECTION_MERGE_BIT;
+		state.current_block->next_block = ops[0];
+		state.current_block->merge = SPIRBlock::MergeSelection;
+		set_block_meta(state, state.current_block->next_block, ParsedIR::BLOCK_META_SELECTION_MERGE_BIT);
 
 		if (length >= 2)
 		{
 			if (ops[1] & SelectionControlFlattenMask)
-				current_block->hint = SPIRBlock::HintFlatten;
+				state.current_block->hint = SPIRBlock::HintFlatten;
 			else if (ops[1] & SelectionControlDontFlattenMask)
-				current_block->hint = SPIRBlock::HintDontFlatten;
+				state.current_block->hint = SPIRBlock::HintDontFlatten;
 		}
 		break;
 	}
 
 	case OpLoopMerge:
 	{
-		if (!current_block)
+		if (!state.current_block)
 			SPIRV_CROSS_THROW("Trying to modify a non-existing block.");
 
-		current_block->merge_block = ops[0];
-		current_block->continue_block = ops[1];
-		current_block->merge = SPIRBlock::MergeLoop;
+		state.current_block->merge_block = ops[0];
+		state.current_block->continue_block = ops[1];
+		state.current_block->merge = SPIRBlock::MergeLoop;
 
-		ir.block_meta[current_block->self] |= ParsedIR::BLOCK_META_LOOP_HEADER_BIT;
-		ir.block_meta[current_block->merge_block] |= ParsedIR::BLOCK_META_LOOP_MERGE_BIT;
+		set_block_meta(state, state.current_block->self, ParsedIR::BLOCK_META_LOOP_HEADER_BIT);
+		set_block_meta(state, state.current_block->merge_block, ParsedIR::BLOCK_META_LOOP_MERGE_BIT);
 
-		ir.continue_block_to_loop_header[current_block->continue_block] = current_block->self;
+		if (state.deferred)
+			state.continue_block_to_loop_header.emplace_back(state.current_block->continue_block,
+			                                                 state.current_block->self);
+		else
+			ir.continue_block_to_loop_header[state.current_block->continue_block] = state.current_block->self;
 
 		// Don't add loop headers to continue blocks,
 		// which would make it impossible branch into the loop header since
 		// they are treated as continues.
-		if (current_block->continue_block != current_block->self)
-			ir.block_meta[current_block->continue_block] |= ParsedIR::BLOCK_META_CONTINUE_BIT;
+		if (state.current_block->continue_block != state.current_block->self)
+			set_block_meta(state, state.current_block->continue_block, ParsedIR::BLOCK_META_CONTINUE_BIT);
 
 		if (length >= 3)
 		{
 			if (ops[2] & LoopControlUnrollMask)
-				current_block->hint = SPIRBlock::HintUnroll;
+				state.current_block->hint = SPIRBlock::HintUnroll;
 			else if (ops[2] & LoopControlDontUnrollMask)
-				current_block->hint = SPIRBlock::HintDontUnroll;
+				state.current_block->hint = SPIRBlock::HintDontUnroll;
 		}
 		break;
 	}
@@ -1015,15 +1415,59 @@ void Parser::parse(const Instruction &instruction)
 	// Actual opcodes.
 	default:
 	{
-		if (!current_block)
+		if (!state.current_block)
 			SPIRV_CROSS_THROW("Currently no block to insert opcode.");
 
-		current_block->ops.push_back(instruction);
+		append_to_block(state.deferred ? state.block_ops : ir.block_ops, state.current_block->ops, instruction);
 		break;
 	}
 	}
 }
 
+uint64_t Parser::get_type_hash(uint32_t id)
+{
+	auto itr = type_hashes.find(id);
+	if (itr != end(type_hashes))
+		return itr->second;
+
+	auto &type = get<SPIRType>(id);
+	Hasher hasher;
+	hasher.u32(type.basetype);
+	hasher.u32(type.width);
+	hasher.u32(type.vecsize);
+	hasher.u32(type.columns);
+	hasher.u32(uint32_t(type.array.size()));
+	for (auto &size : type.array)
+		hasher.u32(size);
+
+	if (type.basetype == SPIRType::Image || type.basetype == SPIRType::SampledImage)
+	{
+		hasher.u32(type.image.type);
+		hasher.u32(type.image.dim);
+		hasher.u32(type.image.depth);
+		hasher.u32(type.image.arrayed);
+		hasher.u32(type.image.ms);
+		hasher.u32(type.image.sampled);
+		hasher.u32(type.image.format);
+		hasher.u32(type.image.access);
+	}
+
+	hasher.u32(uint32_t(type.member_types.size()));
+	if (type.member_types.empty())
+		return hasher.get();
+
+	for (auto &member : type.member_types)
+	{
+		uint64_t member_hash = get_type_hash(member);
+		hasher.u32(uint32_t(member_hash));
+		hasher.u32(uint32_t(member_hash >> 32));
+	}
+
+	uint64_t hash = hasher.get();
+	type_hashes[id] = hash;
+	return hash;
+}
+
 bool Parser::types_are_logically_equivalent(const SPIRType &a, const SPIRType &b) const
 {
 	if (a.basetype != b.basetype)
@@ -1053,7 +1497,9 @@ bool Parser::types_are_logically_equivalent(const SPIRType &a, const SPIRType &b
 	size_t member_types = a.member_types.size();
 	for (size_t i = 0; i < member_types; i++)
 	{
-		if (!types_are_logically_equivalent(get<SPIRType>(a.member_types[i]), get<SPIRType>(b.member_types[i])))
+		// Nested structs are usually the very same type, which is equivalent to itself.
+		if (a.member_types[i] != b.member_types[i] &&
+		    !types_are_logically_equivalent(get<SPIRType>(a.member_types[i]), get<SPIRType>(b.member_types[i])))
 			return false;
 	}
 
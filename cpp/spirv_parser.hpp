@@ -18,19 +18,66 @@
 #define SPIRV_CROSS_PARSER_HPP
 
 #include "spirv_cross_parsed_ir.hpp"
+#include <exception>
+#include <memory>
 #include <stdint.h>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace spirv_cross
 {
+// The instructions of a module and how often each opcode occurs, see scan_instructions().
+struct InstructionScan
+{
+	std::vector<Instruction> instructions;
+
+	// Opcodes from OpcodeCountLimit - 1 up share the last entry.
+	static const uint32_t OpcodeCountLimit = 512;
+	uint32_t opcode_counts[OpcodeCountLimit] = {};
+
+	uint32_t get_opcode_count(spv::Op op) const
+	{
+		uint32_t index = uint32_t(op);
+		return opcode_counts[index < OpcodeCountLimit ? index : OpcodeCountLimit - 1];
+	}
+};
+
+// Splits a module into its instructions and counts their opcodes, in one pass over the words.
+// A module of the other endianness is byte swapped in place along the way.
+// Throws if the header is invalid, or an instruction is empty or goes past the end of the module.
+void scan_instructions(std::vector<uint32_t> &spirv, InstructionScan &scan);
+
 class Parser
 {
 public:
 	Parser(const uint32_t *spirv_data, size_t word_count);
 	Parser(std::vector<uint32_t> spirv);
 
+	// Parses into a ParsedIR which held another module, reusing its allocations.
+	Parser(ParsedIR &&ir, const uint32_t *spirv_data, size_t word_count);
+	Parser(ParsedIR &&ir, std::vector<uint32_t> spirv);
+
+	// Takes over the result of a lazy parse, to parse the functions it skipped with parse_function().
+	explicit Parser(ParsedIR &&ir);
+
 	void parse();
 
+	// Skips function bodies and only records where they are, see ParsedIR::unparsed_functions.
+	// A compiler parses the functions its entry point calls when it is created and in set_entry_point(),
+	// so compiling one entry point of a module with many of them does not parse the others.
+	// Functions which declare globals are always parsed. The default is to parse everything.
+	void set_lazy_function_parsing(bool enable);
+
+	// Parses a function a lazy parse skipped, and every skipped function it calls directly or indirectly.
+	// Returns the functions it parsed.
+	std::vector<uint32_t> parse_function(uint32_t id);
+
+	// Parses function bodies on up to count threads once the global declarations are parsed.
+	// Each thread takes a contiguous run of functions and the runs are merged in module order,
+	// so the IR is the same as after a serial parse. 0 uses one thread per core, the default is 1.
+	void set_thread_count(uint32_t count);
+
 	ParsedIR &get_parsed_ir()
 	{
 		return ir;
@@ -38,12 +85,65 @@ public:
 
 private:
 	ParsedIR ir;
-	SPIRFunction *current_function = nullptr;
-	SPIRBlock *current_block = nullptr;
+	uint32_t thread_count = 1;
+	bool lazy_function_parsing = false;
+
+	struct DeferredID
+	{
+		uint32_t id;
+		uint32_t type;
+		std::unique_ptr<IVariant> value;
+	};
 
-	void parse(const Instruction &instr);
+	struct ParseState
+	{
+		SPIRFunction *current_function = nullptr;
+		SPIRBlock *current_block = nullptr;
+
+		// Set while parsing a run of functions on a worker thread, which must not modify the IR.
+		// The IDs it declares and everything else it would write to the IR are kept here until the run is merged,
+		// and block spans refer to the arrays below instead.
+		bool deferred = false;
+		std::vector<DeferredID> ids;
+		std::vector<Instruction> block_ops;
+		std::vector<SPIRBlock::Phi> block_phis;
+		std::vector<SPIRBlock::Case> block_cases;
+		std::vector<std::pair<uint32_t, ParsedIR::BlockMetaFlags>> block_meta;
+		std::vector<std::pair<uint32_t, uint32_t>> continue_block_to_loop_header;
+		std::vector<uint32_t> image_variables;
+
+		// The instruction a run stopped at, because it failed or has to be parsed serially.
+		size_t stop = 0;
+		std::exception_ptr error;
+	};
+
+	void parse(ParseState &state, const Instruction &instr);
 	const uint32_t *stream(const Instruction &instr) const;
 
+	// Returns the instruction serial parsing continues from.
+	size_t parse_functions(ParseState &state, const std::vector<Instruction> &instructions,
+	                       const std::vector<size_t> &functions, uint32_t threads);
+	void parse_run(ParseState &state, const std::vector<Instruction> &instructions, size_t begin, size_t end);
+	void merge_run(ParseState &state);
+
+	// Returns the instruction after the function, or begin if the function has to be parsed now.
+	size_t skip_function(const std::vector<Instruction> &instructions, size_t begin);
+
+	template <typename T, typename... P>
+	T &set(ParseState &state, uint32_t id, P &&... args)
+	{
+		if (!state.deferred)
+			return set<T>(id, std::forward<P>(args)...);
+
+		std::unique_ptr<T> value(new T(std::forward<P>(args)...));
+		auto &var = *value;
+		var.self = id;
+		state.ids.push_back({ id, T::type, std::move(value) });
+		return var;
+	}
+
+	void set_block_meta(ParseState &state, uint32_t block, ParsedIR::BlockMetaFlags flags);
+
 	template <typename T, typename... P>
 	T &set(uint32_t id, P &&... args)
 	{
@@ -82,9 +182,15 @@ private:
 			return nullptr;
 	}
 
-	// This must be an ordered data structure so we always pick the same type aliases.
-	std::vector<uint32_t> global_struct_cache;
+	// Named structs which are not aliases, by the hash of their name and structure.
+	// Candidates with the same hash must stay in declaration order so we always pick the same type aliases.
+	std::unordered_map<uint64_t, std::vector<uint32_t>> global_struct_cache;
+
+	// Hashes of types with members, so nested structs are hashed once.
+	std::unordered_map<uint32_t, uint64_t> type_hashes;
 
+	// Logically equivalent types have the same hash, see types_are_logically_equivalent().
+	uint64_t get_type_hash(uint32_t id);
 	bool types_are_logically_equivalent(const SPIRType &a, const SPIRType &b) const;
 	bool variable_storage_is_aliased(const SPIRVariable &v) const;
 	void make_constant_null(uint32_t id, uint32_t type);
@@ -8,11 +8,16 @@
 
 static_assert(sizeof(bool) == 1,
               "Config script needed to determine size of bool");
+static_assert(sizeof(ScOptionsGlsl) ==
+                  sizeof(spirv_cross::CompilerGLSL::Options),
+              "ScOptionsGlsl must mirror CompilerGLSL::Options");
 
 struct ScCommon
 {
     ScGcCallbacks gc_callbacks;
-    mutable std::string error_string;
+    mutable std::string error_string{};
+    std::shared_ptr<spirv_cross::TraceRecorder> trace{};
+    std::shared_ptr<spirv_cross::CompileCache> compile_cache{};
 
     void *gc_alloc(const size_t sz) const
     {
@@ -45,6 +50,11 @@ struct ScCompiler
     spirv_cross::Compiler _cl;
 };
 
+struct ScCompileCache
+{
+    std::shared_ptr<spirv_cross::CompileCache> cache;
+};
+
 struct ScCompilerGlsl
 {
     ScCompilerGlsl(ScCommon common, ScDArray<const uint32_t> ir)
@@ -105,6 +115,17 @@ inline std::string to_cpp_string(ScDString ds)
     return std::string{ds.ptr, ds.length};
 }
 
+inline ScDArray<ScDString> to_d_strings(const ScCommon &common,
+                                        const std::vector<std::string> &strs)
+{
+    const auto sz = strs.size();
+    auto *mem =
+        static_cast<ScDString *>(common.gc_alloc(sz * sizeof(ScDString)));
+    for (size_t i = 0; i < sz; ++i)
+        mem[i] = to_d_string(common, strs[i]);
+    return ScDArray<ScDString>{sz, mem};
+}
+
 template <typename T>
 inline ScDArray<T> to_d_array(const ScCommon &common, const std::vector<T> &vec)
 {
@@ -461,6 +482,49 @@ ScResult sc_compiler_get_declared_struct_member_size(const ScCompiler *compiler,
     });
 }
 
+ScResult
+sc_compiler_get_declared_buffer_layout(const ScCompiler *compiler, uint32_t id,
+                                       ScDArray<BufferLayoutMember> *result)
+{
+    return sc_handle(compiler, [&] {
+        const auto layout = compiler->cl()->get_declared_buffer_layout(id);
+        const auto sz = layout.size();
+
+        // all paths share a single allocation, each row slices into it
+        size_t paths_size = 0;
+        for (const auto &member : layout)
+            paths_size += member.path.size();
+        auto *paths =
+            static_cast<char *>(compiler->common().gc_alloc(paths_size));
+        auto *mem = static_cast<BufferLayoutMember *>(
+            compiler->common().gc_alloc(sz * sizeof(BufferLayoutMember)));
+
+        size_t path_offset = 0;
+        for (size_t i = 0; i < sz; ++i) {
+            const auto &member = layout[i];
+            member.path.copy(paths + path_offset, member.path.size());
+            mem[i].path = ScDString{member.path.size(), paths + path_offset};
+            path_offset += member.path.size();
+
+            mem[i].type_id = member.type_id;
+            mem[i].offset = member.offset;
+            mem[i].size = member.size;
+            mem[i].array_stride = member.array_stride;
+            mem[i].matrix_stride = member.matrix_stride;
+            mem[i].basetype = member.basetype;
+            mem[i].vecsize = member.vecsize;
+            mem[i].columns = member.columns;
+            mem[i].row_major = member.row_major;
+            mem[i].std140_alignment = member.std140_alignment;
+            mem[i].std430_alignment = member.std430_alignment;
+            mem[i].std140_compliant = member.std140_compliant;
+            mem[i].std430_compliant = member.std430_compliant;
+        }
+
+        *result = ScDArray<BufferLayoutMember>{sz, mem};
+    });
+}
+
 static std::unordered_set<uint32_t> array_to_set(ScDArray<uint32_t> darr)
 {
     std::unordered_set<uint32_t> set;
@@ -835,6 +899,125 @@ sc_compiler_get_remapped_declared_block_name(const ScCompiler *compiler,
 
 // buffer_block_flags
 
+ScResult sc_compiler_set_stats_enabled(ScCompiler *compiler, bool enable)
+{
+    return sc_handle(compiler,
+                     [&] { compiler->cl()->set_stats_enabled(enable); });
+}
+
+ScResult sc_compiler_get_stats(const ScCompiler *compiler,
+                               spirv_cross::CompilerStats *result)
+{
+    return sc_handle(compiler, [&] { *result = compiler->cl()->get_stats(); });
+}
+
+ScResult sc_compiler_reset_stats(ScCompiler *compiler)
+{
+    return sc_handle(compiler, [&] { compiler->cl()->reset_stats(); });
+}
+
+ScResult
+sc_compiler_get_memory_footprint(const ScCompiler *compiler,
+                                 spirv_cross::CompilerMemoryFootprint *result)
+{
+    return sc_handle(compiler,
+                     [&] { *result = compiler->cl()->get_memory_footprint(); });
+}
+
+ScResult sc_compiler_set_trace_enabled(ScCompiler *compiler, bool enable)
+{
+    return sc_handle(compiler, [&] {
+        auto &trace = compiler->common().trace;
+        if (enable && !trace)
+            trace = std::make_shared<spirv_cross::TraceRecorder>();
+        else if (!enable)
+            trace.reset();
+        compiler->cl()->set_trace_recorder(trace.get());
+    });
+}
+
+ScResult sc_compiler_get_trace_json(const ScCompiler *compiler,
+                                    ScDString *result)
+{
+    return sc_handle(compiler, [&] {
+        const auto &trace = compiler->common().trace;
+        *result = to_d_string(compiler, trace ? trace->get_json()
+                                              : spirv_cross::TraceRecorder()
+                                                    .get_json());
+    });
+}
+
+ScResult sc_compiler_clear_trace(ScCompiler *compiler)
+{
+    return sc_handle(compiler, [&] {
+        if (compiler->common().trace)
+            compiler->common().trace->clear();
+    });
+}
+
+ScResult sc_compiler_get_compile_cache_key(const ScCompiler *compiler,
+                                           ScDString *result)
+{
+    return sc_handle(compiler, [&] {
+        *result =
+            to_d_string(compiler, compiler->cl()->get_compile_cache_key());
+    });
+}
+
+ScResult sc_compile_cache_new(ScDString directory, uint64_t max_size,
+                              ScGcCallbacks gc_callbacks,
+                              ScCompileCache **result, ScDString *error)
+{
+    auto common = ScCommon{gc_callbacks};
+
+    try {
+        *result = new ScCompileCache{
+            std::make_shared<spirv_cross::CompileCache>(
+                to_cpp_string(directory), max_size)};
+    }
+    catch (const spirv_cross::CompilerError &ex) {
+        *error = to_d_string(common, ex.what());
+        return ScResult::CompilationError;
+    }
+    catch (const std::exception &ex) {
+        *error = to_d_string(common, ex.what());
+        return ScResult::Error;
+    }
+    catch (...) {
+        const auto msg = "Unhandled error";
+        *error = ScDString{std::strlen(msg), &msg[0]};
+        return ScResult::Unhandled;
+    }
+    return ScResult::Success;
+}
+
+void sc_compile_cache_delete(ScCompileCache *cache)
+{
+    delete cache;
+}
+
+void sc_compile_cache_get_counters(const ScCompileCache *cache,
+                                   uint64_t *hits, uint64_t *misses)
+{
+    *hits = cache->cache->get_hit_count();
+    *misses = cache->cache->get_miss_count();
+}
+
+void sc_compile_cache_reset_counters(ScCompileCache *cache)
+{
+    cache->cache->reset_counters();
+}
+
+void sc_compile_cache_clear(ScCompileCache *cache)
+{
+    cache->cache->clear();
+}
+
+void sc_compile_cache_flush(ScCompileCache *cache)
+{
+    cache->cache->flush();
+}
+
 // GLSL compiler funcs
 
 ScResult sc_compiler_glsl_new(ScDArray<const uint32_t> ir,
@@ -862,6 +1045,14 @@ ScResult sc_compiler_glsl_new(ScDArray<const uint32_t> ir,
     return ScResult::Success;
 }
 
+ScResult sc_compiler_glsl_reset(ScCompilerGlsl *compiler,
+                                ScDArray<const uint32_t> ir)
+{
+    return sc_handle(compiler, [&] {
+        compiler->cl()->reset(ir.ptr, ir.length);
+    });
+}
+
 ScResult sc_compiler_glsl_get_options(const ScCompilerGlsl *compiler,
                                       ScOptionsGlsl *result)
 {
@@ -912,4 +1103,57 @@ ScResult sc_compiler_glsl_flatten_buffer_block(ScCompilerGlsl *compiler,
                      [&] { compiler->cl()->flatten_buffer_block(id); });
 }
 
+ScResult sc_compiler_glsl_compile_specialization_variants(
+    ScCompilerGlsl *compiler,
+    ScDArray<const ScDArray<const spirv_cross::SpecializationConstantValue>>
+        variants,
+    ScDArray<ScDString> *result)
+{
+    return sc_handle(compiler, [&] {
+        std::vector<std::vector<spirv_cross::SpecializationConstantValue>>
+            cpp_variants(variants.length);
+        for (size_t i = 0; i < variants.length; ++i) {
+            const auto &values = variants.ptr[i];
+            cpp_variants[i].assign(values.ptr, values.ptr + values.length);
+        }
+
+        *result = to_d_strings(
+            compiler->common(),
+            compiler->cl()->compile_specialization_variants(cpp_variants));
+    });
+}
+
+ScResult sc_compiler_glsl_compile_all(ScCompilerGlsl *compiler,
+                                      ScDArray<const ScOptionsGlsl> options,
+                                      ScDArray<ScDString> *result)
+{
+    return sc_handle(compiler, [&] {
+        const auto *profiles =
+            reinterpret_cast<const spirv_cross::CompilerGLSL::Options *>(
+                options.ptr);
+        *result = to_d_strings(
+            compiler->common(),
+            compiler->cl()->compile_all(
+                {profiles, profiles + options.length}));
+    });
+}
+
+ScResult sc_compiler_glsl_set_compile_cache(ScCompilerGlsl *compiler,
+                                            ScCompileCache *cache)
+{
+    return sc_handle(compiler, [&] {
+        auto &compile_cache = compiler->common().compile_cache;
+        compile_cache = cache ? cache->cache : nullptr;
+        compiler->cl()->set_compile_cache(compile_cache.get());
+    });
+}
+
+ScResult sc_compiler_glsl_set_layout_patching_enabled(ScCompilerGlsl *compiler,
+                                                      bool enable)
+{
+    return sc_handle(compiler, [&] {
+        compiler->cl()->set_layout_patching_enabled(enable);
+    });
+}
+
 } // extern "C"
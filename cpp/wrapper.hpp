@@ -23,6 +23,7 @@ extern "C" {
 // forward decl.
 struct ScCompiler;
 struct ScCompilerGlsl;
+struct ScCompileCache;
 
 // return type to indicate if a C++ exception was thrown
 enum class ScResult
@@ -72,6 +73,24 @@ struct EntryPoint
     spv::ExecutionModel execution_model;
 };
 
+struct BufferLayoutMember
+{
+    ScDString path;
+    uint32_t type_id;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t array_stride;
+    uint32_t matrix_stride;
+    uint32_t basetype; // spirv_cross::SPIRType::BaseType
+    uint32_t vecsize;
+    uint32_t columns;
+    bool row_major;
+    uint32_t std140_alignment;
+    uint32_t std430_alignment;
+    bool std140_compliant;
+    bool std430_compliant;
+};
+
 // generic compiler functions
 
 void sc_compiler_delete(ScCompiler *compiler);
@@ -200,6 +219,10 @@ ScResult sc_compiler_get_declared_struct_member_size(const ScCompiler *compiler,
                                                      uint32_t index,
                                                      size_t *result);
 
+ScResult
+sc_compiler_get_declared_buffer_layout(const ScCompiler *compiler, uint32_t id,
+                                       ScDArray<BufferLayoutMember> *result);
+
 ScResult sc_compiler_get_active_interface_variables(const ScCompiler *compiler,
                                                     ScDArray<uint32_t> *result);
 
@@ -325,6 +348,46 @@ sc_compiler_get_remapped_declared_block_name(const ScCompiler *compiler,
 
 // buffer_block_flags
 
+ScResult sc_compiler_set_stats_enabled(ScCompiler *compiler, bool enable);
+
+ScResult sc_compiler_get_stats(const ScCompiler *compiler,
+                               spirv_cross::CompilerStats *result);
+
+ScResult sc_compiler_reset_stats(ScCompiler *compiler);
+
+// approximate heap memory held by the compiler, walks all of its containers
+ScResult
+sc_compiler_get_memory_footprint(const ScCompiler *compiler,
+                                 spirv_cross::CompilerMemoryFootprint *result);
+
+// records a Chrome trace of the compiler's work, owned by the compiler
+ScResult sc_compiler_set_trace_enabled(ScCompiler *compiler, bool enable);
+
+ScResult sc_compiler_get_trace_json(const ScCompiler *compiler,
+                                    ScDString *result);
+
+ScResult sc_compiler_clear_trace(ScCompiler *compiler);
+
+ScResult sc_compiler_get_compile_cache_key(const ScCompiler *compiler,
+                                           ScDString *result);
+
+// on-disk cache of compiled sources, shared by the compilers it is set on
+ScResult sc_compile_cache_new(ScDString directory, uint64_t max_size,
+                              ScGcCallbacks gc_callbacks,
+                              ScCompileCache **result, ScDString *error);
+
+// compilers using the cache keep it alive until they are deleted
+void sc_compile_cache_delete(ScCompileCache *cache);
+
+void sc_compile_cache_get_counters(const ScCompileCache *cache,
+                                   uint64_t *hits, uint64_t *misses);
+
+void sc_compile_cache_reset_counters(ScCompileCache *cache);
+
+void sc_compile_cache_clear(ScCompileCache *cache);
+
+void sc_compile_cache_flush(ScCompileCache *cache);
+
 // GLSL compiler types
 
 struct ScOptionsGlsl
@@ -335,6 +398,9 @@ struct ScOptionsGlsl
     bool vulkan_semantics = false;
     bool separate_shader_objects = false;
     bool flatten_multidimensional_arrays = false;
+    bool enable_420pack_extension = true;
+    bool minify = false;
+    bool minify_identifiers = false;
     enum Precision
     {
         DontCare,
@@ -362,6 +428,10 @@ struct ScOptionsGlsl
 ScResult sc_compiler_glsl_new(ScDArray<const uint32_t> ir, ScGcCallbacks gc_callbacks,
                               ScCompilerGlsl **result, ScDString *error);
 
+// replaces the module, keeping the compiler's allocations for the new one
+ScResult sc_compiler_glsl_reset(ScCompilerGlsl *compiler,
+                                ScDArray<const uint32_t> ir);
+
 ScResult sc_compiler_glsl_get_options(const ScCompilerGlsl *compiler,
                                       ScOptionsGlsl *result);
 
@@ -379,4 +449,27 @@ ScResult sc_compiler_glsl_require_extension(ScCompilerGlsl *compiler,
 
 ScResult sc_compiler_glsl_flatten_buffer_block(ScCompilerGlsl *compiler,
                                                uint32_t id);
+
+// compiles one source per set of specialization constant values,
+// the module is analyzed only once
+ScResult sc_compiler_glsl_compile_specialization_variants(
+    ScCompilerGlsl *compiler,
+    ScDArray<const ScDArray<const spirv_cross::SpecializationConstantValue>>
+        variants,
+    ScDArray<ScDString> *result);
+
+// compiles one source per set of options, the option-independent analysis is
+// shared by all of them
+ScResult sc_compiler_glsl_compile_all(ScCompilerGlsl *compiler,
+                                      ScDArray<const ScOptionsGlsl> options,
+                                      ScDArray<ScDString> *result);
+
+// null to disable caching
+ScResult sc_compiler_glsl_set_compile_cache(ScCompilerGlsl *compiler,
+                                            ScCompileCache *cache);
+
+// when only binding, set and location values change between two compiles,
+// the second one patches the output of the first
+ScResult sc_compiler_glsl_set_layout_patching_enabled(ScCompilerGlsl *compiler,
+                                                      bool enable);
 } // extern "C"
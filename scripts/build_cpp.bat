@@ -21,7 +21,7 @@ call "%~dp0msvcEnv.bat" %VCARCH%
 MD %BUILD_DIR%
 CD %BUILD_DIR%
 
-cmake -G "NMake Makefiles" -DCMAKE_BUILD_TYPE=%BUILD_TYPE% %CPP_DIR%
+cmake -G "NMake Makefiles" -DCMAKE_BUILD_TYPE=%BUILD_TYPE% -DSPIRV_CROSS_BENCH=OFF %CPP_DIR%
 IF %ERRORLEVEL% NEQ 0 EXIT 1
 
 cmake --build %BUILD_DIR%
@@ -30,7 +30,7 @@ function build_sc() {
     mkdir -p $BUILD_DIR || exit 1
     cd $BUILD_DIR
 
-    cmake -G $GEN -DCMAKE_BUILD_TYPE=$BUILD_TYPE $CPP_DIR -DCMAKE_CXX_FLAGS=$FLAG || exit 1
+    cmake -G $GEN -DCMAKE_BUILD_TYPE=$BUILD_TYPE -DSPIRV_CROSS_BENCH=OFF $CPP_DIR -DCMAKE_CXX_FLAGS=$FLAG || exit 1
     cmake --build $BUILD_DIR || exit 1
 
     mkdir -p $LIB_DIR/posix-$ARCH